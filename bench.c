@@ -0,0 +1,390 @@
+/*
+ * Simulator throughput benchmark.
+ *
+ * Build separately from the simulator:
+ *   cc -O2 -o bench bench.c -lm
+ *
+ * Generate one synthetic trace:
+ *   ./bench -g zipf -n 1000000 -f 1048576 -w 30 > zipf.trace
+ *
+ * Run the configuration matrix against ./sim and report JSON:
+ *   ./bench -s ./sim -o results.json
+ *
+ * Compare against an earlier run; exits with 1 when any (trace, config)
+ * pair lost more than -x percent of its accesses/second:
+ *   ./bench -s ./sim -b baseline.json -x 10
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "common.h"
+
+#define BENCH_BLOCK_SIZE 64
+#define BENCH_MAX_RESULTS 256
+
+typedef enum {
+    GEN_SEQ,
+    GEN_STRIDE,
+    GEN_RANDOM,
+    GEN_ZIPF,
+    GEN_CHASE,
+    GEN_COUNT
+} generator_t;
+
+static const char *generator_names[GEN_COUNT] = {
+    "seq", "stride", "random", "zipf", "chase"
+};
+
+typedef struct {
+    const char *name;
+    const char *args;
+} bench_config_t;
+
+// Simulator configurations exercised by the harness.
+static const bench_config_t bench_configs[] = {
+    { "l1_dm",        "-S 16384 -A 1 -B 64 -L 1" },
+    { "l1_4way",      "-S 16384 -A 4 -B 64 -L 1" },
+    { "l1_16way",     "-S 16384 -A 16 -B 64 -L 1" },
+    { "l1_4way_xor",  "-S 16384 -A 4 -B 64 -L 1 -H xor" },
+    { "l1_4way_skew", "-S 16384 -A 4 -B 64 -L 1 -H skew" },
+    { "l2_none",      "-S 16384 -A 4 -B 64 -L 2 -P none" },
+    { "l2_seq",       "-S 16384 -A 4 -B 64 -L 2 -P SEQ" },
+    { "l2_str",       "-S 16384 -A 4 -B 64 -L 2 -P STR" },
+    { "l2_sector16",  "-S 16384 -A 4 -B 64 -L 2 -P SEQ -G 16" },
+    { "l2_seq_dram",  "-S 16384 -A 4 -B 64 -L 2 -P SEQ -X on" },
+    { "l2_custom",    "-S 16384 -A 4 -B 64 -L 2 -P custom" },
+    { "l2_8way_seq",  "-S 16384 -A 8 -B 64 -L 2 -P SEQ" },
+};
+
+#define NUM_BENCH_CONFIGS (sizeof(bench_configs) / sizeof(bench_configs[0]))
+
+typedef struct {
+    char trace[32];
+    char config[32];
+    double seconds;
+    double accesses_per_sec;
+    double ns_per_access;
+    long peak_rss_kb;
+} bench_result_t;
+
+// Generator parameters.
+static uint64_t num_accesses = 1000000;
+static uint64_t footprint = 1 << 20;
+static uint32_t write_pct = 30;
+static uint32_t stride = 4 * BENCH_BLOCK_SIZE;
+static double zipf_alpha = 0.99;
+static uint64_t seed = 1;
+
+static uint64_t rng_state;
+
+static double rng_unit(void) {
+    return (splitmix64(&rng_state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static generator_t parse_generator(const char *name) {
+    for (int g = 0; g < GEN_COUNT; g++) {
+        if (strcmp(name, generator_names[g]) == 0) return (generator_t)g;
+    }
+    return GEN_COUNT;
+}
+
+// Write num_accesses accesses of the given pattern in the simulator's text
+// trace format. Every pattern stays inside [0, footprint).
+static int generate_trace(generator_t gen, FILE *out) {
+    uint64_t num_blocks = footprint / BENCH_BLOCK_SIZE;
+    uint32_t *next = NULL;
+    uint64_t addr = 0;
+    uint64_t cur = 0;
+    double zipf_base = 0;
+
+    if (num_blocks == 0) num_blocks = 1;
+    rng_state = seed;
+
+    if (gen == GEN_CHASE) {
+        // Sattolo's algorithm gives a single cycle through every block.
+        next = malloc(num_blocks * sizeof(uint32_t));
+        if (next == NULL) return -1;
+        for (uint64_t i = 0; i < num_blocks; i++) next[i] = (uint32_t)i;
+        for (uint64_t i = num_blocks - 1; i > 0; i--) {
+            uint64_t j = splitmix64(&rng_state) % i;
+            uint32_t t = next[i];
+            next[i] = next[j];
+            next[j] = t;
+        }
+    } else if (gen == GEN_ZIPF) {
+        zipf_base = pow((double)num_blocks, 1.0 - zipf_alpha) - 1.0;
+    }
+
+    for (uint64_t n = 0; n < num_accesses; n++) {
+        switch (gen) {
+        case GEN_SEQ:
+            addr = (n * 4) % footprint;
+            break;
+        case GEN_STRIDE:
+            addr = (n * stride) % footprint;
+            break;
+        case GEN_RANDOM:
+            addr = (splitmix64(&rng_state) % num_blocks) * BENCH_BLOCK_SIZE;
+            break;
+        case GEN_ZIPF: {
+            // Continuous inverse-CDF approximation of a Zipf distribution,
+            // with ranks scattered over the footprint.
+            double u = rng_unit();
+            uint64_t rank = (uint64_t)pow(zipf_base * u + 1.0, 1.0 / (1.0 - zipf_alpha)) - 1;
+            if (rank >= num_blocks) rank = num_blocks - 1;
+            addr = ((rank * 2654435761ULL) % num_blocks) * BENCH_BLOCK_SIZE;
+            break;
+        }
+        case GEN_CHASE:
+            cur = next[cur];
+            addr = cur * BENCH_BLOCK_SIZE;
+            break;
+        default:
+            break;
+        }
+        char op = (splitmix64(&rng_state) % 100) < write_pct ? 'W' : 'R';
+        fprintf(out, "%c %" PRIx64 "\n", op, addr);
+    }
+
+    free(next);
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Run sim once on trace_path with config args. Fills seconds and peak RSS.
+static int run_sim(const char *sim_path, const char *trace_path, const char *args,
+                   double *seconds, long *peak_rss_kb) {
+    char *argv[64];
+    char buf[256];
+    int argc = 0;
+
+    snprintf(buf, sizeof(buf), "%s", args);
+    argv[argc++] = (char *)sim_path;
+    argv[argc++] = "-t";
+    argv[argc++] = (char *)trace_path;
+    for (char *tok = strtok(buf, " "); tok != NULL && argc < 63; tok = strtok(NULL, " ")) {
+        argv[argc++] = tok;
+    }
+    argv[argc] = NULL;
+
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        execv(sim_path, argv);
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return -1;
+    *seconds = now_seconds() - start;
+    *peak_rss_kb = ru.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return 0;
+}
+
+static void print_result_json(FILE *out, const bench_result_t *r, int last) {
+    fprintf(out, "    {\"trace\": \"%s\", \"config\": \"%s\", \"seconds\": %.6f, "
+            "\"accesses_per_sec\": %.1f, \"ns_per_access\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+            r->trace, r->config, r->seconds, r->accesses_per_sec, r->ns_per_access,
+            r->peak_rss_kb, last ? "" : ",");
+}
+
+static int json_string_field(const char *line, const char *key, char *val, size_t len) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\": \"", key);
+    const char *p = strstr(line, pat);
+    if (p == NULL) return -1;
+    p += strlen(pat);
+    const char *e = strchr(p, '"');
+    if (e == NULL || (size_t)(e - p) >= len) return -1;
+    memcpy(val, p, e - p);
+    val[e - p] = '\0';
+    return 0;
+}
+
+static int json_number_field(const char *line, const char *key, double *val) {
+    char pat[64];
+    snprintf(pat, sizeof(pat), "\"%s\": ", key);
+    const char *p = strstr(line, pat);
+    if (p == NULL) return -1;
+    *val = strtod(p + strlen(pat), NULL);
+    return 0;
+}
+
+// Compare results against a baseline written by an earlier run. Only the
+// one-result-per-line layout produced by print_result_json() is understood.
+static int compare_with_baseline(const char *path, const bench_result_t *results, int n,
+                                 double threshold_pct) {
+    FILE *fp = fopen(path, "r");
+    char line[512];
+    int regressions = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot open baseline %s.\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char trace[32], config[32];
+        double base;
+        if (json_string_field(line, "trace", trace, sizeof(trace)) ||
+            json_string_field(line, "config", config, sizeof(config)) ||
+            json_number_field(line, "accesses_per_sec", &base) || base <= 0) {
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            if (strcmp(results[i].trace, trace) != 0 || strcmp(results[i].config, config) != 0) continue;
+            double change = (results[i].accesses_per_sec - base) / base * 100.0;
+            if (change < -threshold_pct) {
+                fprintf(stderr, "REGRESSION %s/%s: %.1f -> %.1f accesses/s (%.1f%%)\n",
+                        trace, config, base, results[i].accesses_per_sec, change);
+                regressions++;
+            }
+        }
+    }
+
+    fclose(fp);
+    return regressions;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "Usage: ./bench [-g <seq|stride|random|zipf|chase>] [-s <sim>] [-n <accesses>]\n"
+            "               [-f <footprint>] [-w <write_pct>] [-k <stride>] [-a <alpha>]\n"
+            "               [-e <seed>] [-r <repeats>] [-d <tmp_dir>] [-o <json_out>]\n"
+            "               [-b <baseline_json>] [-x <threshold_pct>]\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *sim_path = "./sim";
+    const char *tmp_dir = "/tmp";
+    const char *json_out = NULL;
+    const char *baseline = NULL;
+    double threshold_pct = 5.0;
+    int repeats = 3;
+    int gen_only = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "g:s:n:f:w:k:a:e:r:d:o:b:x:")) != -1) {
+        switch (opt) {
+        case 'g':
+            gen_only = parse_generator(optarg);
+            if (gen_only == GEN_COUNT) {
+                usage();
+                return 2;
+            }
+            break;
+        case 's': sim_path = optarg; break;
+        case 'n': num_accesses = strtoull(optarg, NULL, 0); break;
+        case 'f': footprint = strtoull(optarg, NULL, 0); break;
+        case 'w': write_pct = atoi(optarg); break;
+        case 'k': stride = strtoul(optarg, NULL, 0); break;
+        case 'a': zipf_alpha = atof(optarg); break;
+        case 'e': seed = strtoull(optarg, NULL, 0); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'd': tmp_dir = optarg; break;
+        case 'o': json_out = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 'x': threshold_pct = atof(optarg); break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (num_accesses == 0 || footprint < BENCH_BLOCK_SIZE || write_pct > 100 ||
+        stride == 0 || zipf_alpha <= 0 || zipf_alpha == 1.0 || repeats < 1) {
+        usage();
+        return 2;
+    }
+
+    if (gen_only >= 0) {
+        return generate_trace((generator_t)gen_only, stdout) ? 1 : 0;
+    }
+
+    static bench_result_t results[BENCH_MAX_RESULTS];
+    int num_results = 0;
+
+    for (int g = 0; g < GEN_COUNT; g++) {
+        char trace_path[512];
+        snprintf(trace_path, sizeof(trace_path), "%s/bench_%s_%d.trace", tmp_dir,
+                 generator_names[g], (int)getpid());
+        FILE *fp = fopen(trace_path, "w");
+        if (fp == NULL || generate_trace((generator_t)g, fp)) {
+            fprintf(stderr, "Cannot generate %s.\n", trace_path);
+            if (fp != NULL) fclose(fp);
+            return 1;
+        }
+        fclose(fp);
+
+        for (size_t c = 0; c < NUM_BENCH_CONFIGS && num_results < BENCH_MAX_RESULTS; c++) {
+            bench_result_t *r = &results[num_results];
+            double best = 0;
+            long rss = 0;
+
+            // Keep the fastest of several runs to damp scheduler noise.
+            for (int i = 0; i < repeats; i++) {
+                double seconds;
+                long peak;
+                if (run_sim(sim_path, trace_path, bench_configs[c].args, &seconds, &peak)) {
+                    fprintf(stderr, "sim failed on %s with %s.\n", trace_path, bench_configs[c].args);
+                    unlink(trace_path);
+                    return 1;
+                }
+                if (i == 0 || seconds < best) best = seconds;
+                if (peak > rss) rss = peak;
+            }
+
+            snprintf(r->trace, sizeof(r->trace), "%s", generator_names[g]);
+            snprintf(r->config, sizeof(r->config), "%s", bench_configs[c].name);
+            r->seconds = best;
+            r->accesses_per_sec = num_accesses / best;
+            r->ns_per_access = best * 1e9 / num_accesses;
+            r->peak_rss_kb = rss;
+            num_results++;
+        }
+        unlink(trace_path);
+    }
+
+    FILE *out = stdout;
+    if (json_out != NULL) {
+        out = fopen(json_out, "w");
+        if (out == NULL) {
+            fprintf(stderr, "Cannot write %s.\n", json_out);
+            return 1;
+        }
+    }
+    fprintf(out, "{\n  \"accesses\": %" PRIu64 ",\n  \"footprint\": %" PRIu64 ",\n  \"write_pct\": %u,\n  \"results\": [\n",
+            num_accesses, footprint, write_pct);
+    for (int i = 0; i < num_results; i++) {
+        print_result_json(out, &results[i], i == num_results - 1);
+    }
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    if (baseline != NULL) {
+        int regressions = compare_with_baseline(baseline, results, num_results, threshold_pct);
+        if (regressions != 0) return 1;
+    }
+    return 0;
+}
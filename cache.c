@@ -1,628 +1,897 @@
 #include "cache.h"
+#include "tlb.h"
+#include "eventlog.h"
+#include "interval.h"
+#include "pcstats.h"
+#include "dram.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <string.h>  
-
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The LRU stamp and both state bits share one word. valid covers the tag and
+// dirty is set while any sector is dirty; the sector masks hold one bit per
+// sector and are all ones-or-zero for unsectored caches.
 typedef struct {
-  bool valid;
-  uint32_t tag;
-  bool dirty;
-  uint32_t lru_counter;
+  uint64_t tag;
+  uint64_t lru_counter : 62;
+  uint64_t valid : 1;
+  uint64_t dirty : 1;
+  uint32_t sector_valid;
+  uint32_t sector_dirty;
 } block_t;
 
+// PREFETCH_STR keeps a reference prediction table of per-PC block strides.
+// Accesses without a PC are tracked per 4 KiB region of the address space
+// instead, which finds strided streams but confuses interleaved ones. Keys of
+// region entries are complemented so they cannot alias a PC.
+#define STRIDE_TABLE_BITS 8
+#define STRIDE_TABLE_ENTRIES (1u << STRIDE_TABLE_BITS)
+#define STRIDE_REGION_SHIFT 12
+#define STRIDE_CONFIDENCE_MAX 3
+#define STRIDE_CONFIDENCE_ISSUE 2
+
+typedef struct {
+    uint64_t key;
+    uint64_t last_block;
+    int64_t stride;
+    uint32_t confidence;
+    uint32_t valid;
+} stride_entry_t;
+
+// Sets are stored in pages of up to CACHE_SET_PAGE_SETS sets that are only
+// allocated when one of their sets is first touched, so multi-GiB
+// configurations cost host memory in proportion to the footprint simulated.
+#define CACHE_SET_PAGE_SHIFT 10
+#define CACHE_SET_PAGE_SETS (1ULL << CACHE_SET_PAGE_SHIFT)
+
+// How a level maps a block address to a set. Everything but INDEX_MODULO
+// stores the whole block address as the tag, so victims can be
+// reconstructed without inverting the index function. The skewed functions
+// hash every way differently; INDEX_ZCACHE additionally relocates blocks to
+// their alternative ways on replacement.
 typedef enum {
-    PREFETCH_NONE,
-    PREFETCH_SEQ,
-    PREFETCH_STR,
-    PREFETCH_CUSTOM
-} prefetch_policy_t;
+    INDEX_MODULO,
+    INDEX_XOR,
+    INDEX_PRIME,
+    INDEX_SKEW,
+    INDEX_ZCACHE
+} index_function_t;
 
 typedef struct {
-    uint32_t lru_counter;
-} lru_info_t;
+    uint64_t num_sets;
+    uint32_t associativity;
+    uint32_t offset_bits;
+    uint32_t index_bits;
+    uint32_t tag_shift;
+    uint32_t sector_bits;
+    uint32_t sectors_per_block;
+    index_function_t index_function;
+    uint64_t prime_sets;
+    uint64_t sets_per_page;
+    uint64_t num_set_pages;
+    block_t **set_pages;
+} cache_level_t;
+
+// The ways a block address may live in. Set-indexed levels keep all of
+// them in one set; skewed levels leave set NULL and locate each way with its
+// own hash.
+typedef struct {
+    cache_level_t *level;
+    block_t *set;
+    uint64_t block;
+} set_ref_t;
 
-prefetch_policy_t prefetch_policy = PREFETCH_NONE;
+#define WAY(ref, way) (*way_of(&(ref), (way)))
+#define PEEK_WAY(ref, way) (*peek_way(&(ref), (way)))
 
-uint32_t L1_cache_total_accesses = 0;
-uint32_t L1_cache_hits = 0;
-uint32_t L1_cache_misses = 0;
-uint32_t L1_cache_read_accesses = 0;
-uint32_t L1_cache_read_hits = 0;
-uint32_t L1_cache_write_accesses = 0;
-uint32_t L1_cache_write_hits = 0;
-uint32_t L2_cache_total_accesses = 0;
-uint32_t L2_cache_hits = 0;
-uint32_t L2_cache_misses = 0;
-uint32_t L2_cache_read_accesses = 0;
-uint32_t L2_cache_read_hits = 0;
-uint32_t L2_cache_write_accesses = 0;
-uint32_t L2_cache_write_hits = 0;
-uint32_t memory_total_accesses = 0;
-uint32_t memory_read_accesses = 0;
-uint32_t memory_write_accesses = 0;
+prefetch_policy_t prefetch_policy = PREFETCH_NONE;
+index_function_t L1_index_function = INDEX_MODULO;
+index_function_t L2_index_function = INDEX_MODULO;
+
+uint64_t L1_cache_total_accesses = 0;
+uint64_t L1_cache_hits = 0;
+uint64_t L1_cache_misses = 0;
+uint64_t L1_cache_read_accesses = 0;
+uint64_t L1_cache_read_hits = 0;
+uint64_t L1_cache_write_accesses = 0;
+uint64_t L1_cache_write_hits = 0;
+uint64_t L2_cache_total_accesses = 0;
+uint64_t L2_cache_hits = 0;
+uint64_t L2_cache_misses = 0;
+uint64_t L2_cache_read_accesses = 0;
+uint64_t L2_cache_read_hits = 0;
+uint64_t L2_cache_write_accesses = 0;
+uint64_t L2_cache_write_hits = 0;
+uint64_t memory_total_accesses = 0;
+uint64_t memory_read_accesses = 0;
+uint64_t memory_write_accesses = 0;
+uint64_t memory_read_bytes = 0;
+uint64_t memory_write_bytes = 0;
 
 uint32_t cache_level = 1;
-uint32_t L1_cache_size = 4096;
+uint64_t L1_cache_size = 4096;
 uint32_t L1_cache_associativity = 1;
 uint32_t L1_cache_block_size = 4;
-uint32_t L2_cache_size = 65536;
+uint64_t L2_cache_size = 65536;
 uint32_t L2_cache_associativity = 1;
 uint32_t L2_cache_block_size = 4;
+uint32_t cache_sector_size = 0;
 
-block_t ***cache;
-block_t ***L2_cache;
+static cache_level_t L1;
+static cache_level_t L2;
 
-lru_info_t **L1_lru_info;
-lru_info_t **L2_lru_info;
+static uint64_t global_time = 1;
+static uint64_t zcache_relocations[2] = { 0, 0 };
 
-static uint32_t global_time = 1;
+static stride_entry_t stride_table[STRIDE_TABLE_ENTRIES];
 
-static uint32_t log2_u32(uint32_t x);
-static void invalidate_L1_block_if_present(uint32_t pa);
-static void compute_L1_parts(uint32_t pa, uint32_t *index, uint32_t *tag, uint32_t *offset_bits, uint32_t *index_bits, uint32_t num_sets);
-static void compute_L2_parts(uint32_t pa, uint32_t *index, uint32_t *tag, uint32_t *offset_bits, uint32_t *index_bits, uint32_t num_sets);
-static uint32_t reconstruct_pa_from_tag_index(uint32_t tag, uint32_t index, uint32_t offset_bits, uint32_t index_bits);
+// Warm-start checkpointing. A checkpoint captures the whole hierarchy (tags,
+// valid/dirty bits, LRU stamps and prefetcher configuration) so a measured run
+// can restore it instead of replaying the warm-up part of the trace. The
+// stride table of PREFETCH_STR follows the cache blocks, and with address
+// translation enabled so do the TLBs and page table.
+// Only valid blocks are stored, so the file scales with the cached footprint
+// rather than with the configured capacity. The DRAM model is not saved: a
+// restored run starts with empty queues and every row closed.
+#define CHECKPOINT_MAGIC "CSIMCKPT"
+#define CHECKPOINT_VERSION 6
+#define CHECKPOINT_NUM_COUNTERS 19
 
-void update_lru(uint32_t index, uint32_t accessed_way);
-void update_lru_L2(uint32_t index, uint32_t accessed_way);
-int find_lru_way(uint32_t index);
-int find_lru_way_L2(uint32_t index);
-int read_from_L2_cache_real(uint32_t pa);
-int write_to_L2_cache_real(uint32_t pa);
-void install_to_L2_cache(uint32_t pa); 
+#define CHECKPOINT_BLOCK_DIRTY 0x1
 
-int read_from_memory(uint32_t pa) { return 0; }
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t cache_level;
+    uint32_t prefetch_policy;
+    uint64_t L1_cache_size;
+    uint32_t L1_cache_associativity;
+    uint32_t L1_cache_block_size;
+    uint64_t L2_cache_size;
+    uint32_t L2_cache_associativity;
+    uint32_t L2_cache_block_size;
+    uint32_t tlb_enabled;
+    uint32_t index_functions;
+    uint32_t sector_size;
+    uint32_t pad;
+    uint64_t L1_valid_blocks;
+    uint64_t L2_valid_blocks;
+    uint64_t global_time;
+    uint64_t access_count;
+    uint64_t counters[CHECKPOINT_NUM_COUNTERS];
+} checkpoint_header_t;
 
-int write_to_memory(uint32_t pa) { return 0; }
+typedef struct {
+    uint64_t tag;
+    uint64_t lru_counter;
+    uint64_t index;
+    uint32_t way;
+    uint32_t flags;
+    uint32_t sector_valid;
+    uint32_t sector_dirty;
+} checkpoint_block_t;
+
+char *checkpoint_save_file = NULL;
+char *checkpoint_restore_file = NULL;
+uint64_t checkpoint_at_access = 0;
+
+static void invalidate_L1_block_if_present(uint64_t pa);
+static void compute_parts(const cache_level_t *level, uint64_t pa, uint64_t *index, uint64_t *tag);
+static uint64_t reconstruct_pa_from_tag_index(const cache_level_t *level, uint64_t tag, uint64_t index);
+
+void update_lru(const set_ref_t *set, uint32_t accessed_way);
+void update_lru_L2(const set_ref_t *set, uint32_t accessed_way);
+int find_lru_way(set_ref_t *set);
+int find_lru_way_L2(set_ref_t *set);
+int read_from_L2_cache_real(uint64_t pa);
+int write_to_L2_cache_real(uint64_t pa, uint32_t sectors);
+void install_to_L2_cache(uint64_t pa);
+
+int read_from_memory(uint64_t pa, uint64_t bytes) {
+    memory_total_accesses++;
+    memory_read_accesses++;
+    memory_read_bytes += bytes;
+    dram_access(pa, bytes, false);
+    return 0;
+}
+
+int write_to_memory(uint64_t pa, uint64_t bytes) {
+    memory_total_accesses++;
+    memory_write_accesses++;
+    memory_write_bytes += bytes;
+    dram_access(pa, bytes, true);
+    return 0;
+}
 
 
-int read_from_L2_cache(uint32_t pa) { 
+int read_from_L2_cache(uint64_t pa) {
     return read_from_L2_cache_real(pa);
 }
 
-int write_to_L2_cache(uint32_t pa) { 
-    return write_to_L2_cache_real(pa);
+// sectors are the dirty sectors of an L1 victim; they are written whole, so
+// none of them has to be fetched first.
+int write_to_L2_cache(uint64_t pa, uint32_t sectors) {
+    return write_to_L2_cache_real(pa, sectors);
 }
 
-static uint32_t log2_u32(uint32_t x) {
-    uint32_t r = 0;
-    while (x > 1) { x >>= 1; r++; }
-    return r;
+static uint64_t largest_prime_at_most(uint64_t n) {
+    for (; n > 2; n--) {
+        bool prime = true;
+        for (uint64_t d = 2; d * d <= n && prime; d++) {
+            if (n % d == 0) prime = false;
+        }
+        if (prime) return n;
+    }
+    return n;
 }
 
-static uint32_t reconstruct_pa_from_tag_index(uint32_t tag, uint32_t index, uint32_t offset_bits, uint32_t index_bits) {
-    return (tag << (offset_bits + index_bits)) | (index << offset_bits);
+static void init_cache_level(cache_level_t *level, uint64_t size, uint32_t block_size, uint32_t associativity,
+                             index_function_t index_function) {
+    uint64_t num_sets = 0;
+    if (block_size != 0 && associativity != 0) {
+        num_sets = (size / block_size) / associativity;
+    }
+    if (num_sets == 0) num_sets = 1;
+
+    level->num_sets = num_sets;
+    level->associativity = associativity;
+    level->offset_bits = log2_u64(block_size);
+    level->index_bits = (num_sets > 1) ? log2_u64(num_sets) : 0;
+    level->sector_bits = log2_u64(cache_sector_size);
+    level->sectors_per_block = block_size / cache_sector_size;
+    level->index_function = index_function;
+    level->tag_shift = level->offset_bits + (index_function == INDEX_MODULO ? level->index_bits : 0);
+    level->prime_sets = index_function == INDEX_PRIME ? largest_prime_at_most(num_sets) : num_sets;
+    level->sets_per_page = num_sets < CACHE_SET_PAGE_SETS ? num_sets : CACHE_SET_PAGE_SETS;
+    level->num_set_pages = (num_sets + level->sets_per_page - 1) / level->sets_per_page;
+    level->set_pages = calloc(level->num_set_pages, sizeof(block_t *));
+    if (level->set_pages == NULL) {
+        printf("Cannot allocate cache.\n");
+        exit(-1);
+    }
 }
 
-static void compute_L1_parts(uint32_t pa, uint32_t *index, uint32_t *tag, uint32_t *offset_bits_ptr, uint32_t *index_bits_ptr, uint32_t num_sets) {
-    uint32_t offset_bits = log2_u32(L1_cache_block_size);
-    uint32_t index_bits = (num_sets > 1) ? log2_u32(num_sets) : 0;
-    uint32_t idx = (num_sets > 1) ? ((pa >> offset_bits) & (num_sets - 1)) : 0;
-    uint32_t t = pa >> (offset_bits + index_bits);
-    if (index) *index = idx;
-    if (tag) *tag = t;
-    if (offset_bits_ptr) *offset_bits_ptr = offset_bits;
-    if (index_bits_ptr) *index_bits_ptr = index_bits;
+static void free_cache_level(cache_level_t *level) {
+    if (level->set_pages == NULL) return;
+    for (uint64_t p = 0; p < level->num_set_pages; p++) {
+        free(level->set_pages[p]);
+    }
+    free(level->set_pages);
+    level->set_pages = NULL;
 }
 
-static void compute_L2_parts(uint32_t pa, uint32_t *index, uint32_t *tag, uint32_t *offset_bits_ptr, uint32_t *index_bits_ptr, uint32_t num_sets) {
-    uint32_t offset_bits = log2_u32(L2_cache_block_size);
-    uint32_t index_bits = (num_sets > 1) ? log2_u32(num_sets) : 0;
-    uint32_t idx = (num_sets > 1) ? ((pa >> offset_bits) & (num_sets - 1)) : 0;
-    uint32_t t = pa >> (offset_bits + index_bits);
+// Return the blocks of a set, allocating its page (all blocks invalid) on
+// first touch.
+static block_t *get_set(cache_level_t *level, uint64_t index) {
+    block_t **page = &level->set_pages[index >> CACHE_SET_PAGE_SHIFT];
+    if (*page == NULL) {
+        *page = calloc(level->sets_per_page * level->associativity, sizeof(block_t));
+        if (*page == NULL) {
+            printf("Cannot allocate cache.\n");
+            exit(-1);
+        }
+    }
+    return *page + (index & (CACHE_SET_PAGE_SETS - 1)) * level->associativity;
+}
+
+// Like get_set(), but returns NULL for a set that was never touched.
+static block_t *peek_set(const cache_level_t *level, uint64_t index) {
+    block_t *page = level->set_pages[index >> CACHE_SET_PAGE_SHIFT];
+    if (page == NULL) return NULL;
+    return page + (index & (CACHE_SET_PAGE_SETS - 1)) * level->associativity;
+}
+
+static bool is_skewed(const cache_level_t *level) {
+    return level->index_function == INDEX_SKEW || level->index_function == INDEX_ZCACHE;
+}
+
+// Set of block in the given way of a skewed level. Each way mixes the block
+// address with its own constant.
+static uint64_t skew_index(const cache_level_t *level, uint64_t block, uint32_t way) {
+    if (level->index_bits == 0) return 0;
+    return mix64(block + (way + 1) * 0x9E3779B97F4A7C15ULL) >> (64 - level->index_bits);
+}
+
+static uint64_t set_index(const cache_level_t *level, uint64_t block) {
+    switch (level->index_function) {
+    case INDEX_XOR: {
+        // Fold all upper block-address bits onto the index bits.
+        uint64_t idx = 0;
+        if (level->index_bits == 0) return 0;
+        for (; block != 0; block >>= level->index_bits) idx ^= block;
+        return idx & (level->num_sets - 1);
+    }
+    case INDEX_PRIME:
+        return block % level->prime_sets;
+    case INDEX_SKEW:
+    case INDEX_ZCACHE:
+        return skew_index(level, block, 0);
+    default:
+        return block & (level->num_sets - 1);
+    }
+}
+
+static uint64_t reconstruct_pa_from_tag_index(const cache_level_t *level, uint64_t tag, uint64_t index) {
+    if (level->index_function != INDEX_MODULO) return tag << level->offset_bits;
+    return (tag << (level->offset_bits + level->index_bits)) | (index << level->offset_bits);
+}
+
+// index is the set of pa (of way 0 on skewed levels) and tag what the level
+// stores to identify it.
+static void compute_parts(const cache_level_t *level, uint64_t pa, uint64_t *index, uint64_t *tag) {
+    uint64_t idx = set_index(level, pa >> level->offset_bits);
+    uint64_t t = pa >> level->tag_shift;
     if (index) *index = idx;
     if (tag) *tag = t;
-    if (offset_bits_ptr) *offset_bits_ptr = offset_bits;
-    if (index_bits_ptr) *index_bits_ptr = index_bits;
 }
 
-static void invalidate_L1_block_if_present(uint32_t pa) {
+static set_ref_t get_set_ref(cache_level_t *level, uint64_t pa, uint64_t index) {
+    set_ref_t ref = { level, NULL, pa >> level->offset_bits };
+    if (!is_skewed(level)) ref.set = get_set(level, index);
+    return ref;
+}
+
+// Like get_set_ref(), but false for a set-indexed level whose set was never
+// touched.
+static bool peek_set_ref(cache_level_t *level, uint64_t pa, uint64_t index, set_ref_t *ref) {
+    ref->level = level;
+    ref->set = NULL;
+    ref->block = pa >> level->offset_bits;
+    if (is_skewed(level)) return true;
+    ref->set = peek_set(level, index);
+    return ref->set != NULL;
+}
+
+static inline block_t *way_of(const set_ref_t *ref, uint32_t way) {
+    if (ref->set != NULL) return &ref->set[way];
+    return &get_set(ref->level, skew_index(ref->level, ref->block, way))[way];
+}
+
+// Stands in for the ways of set pages that were never touched.
+static const block_t invalid_block;
+
+// Read-only way_of() for lookups and victim searches. Each way of a skewed
+// level lives in its own set, so allocating them all on a probe would undo
+// the lazy set pages; only the way that is filled gets allocated.
+static inline const block_t *peek_way(const set_ref_t *ref, uint32_t way) {
+    if (ref->set != NULL) return &ref->set[way];
+    const block_t *set = peek_set(ref->level, skew_index(ref->level, ref->block, way));
+    return set != NULL ? &set[way] : &invalid_block;
+}
+
+static uint64_t block_address(const cache_level_t *level, uint64_t pa) {
+    return pa & ~((1ULL << level->offset_bits) - 1);
+}
+
+static uint32_t sector_mask(const cache_level_t *level, uint64_t pa) {
+    return 1u << ((pa >> level->sector_bits) & (level->sectors_per_block - 1));
+}
+
+static uint64_t sector_bytes(uint32_t sectors) {
+    return (uint64_t)__builtin_popcount(sectors) * cache_sector_size;
+}
+
+// Record the block about to be replaced in a set, if there is one. Only
+// called while the event log is recording the current access.
+static void log_victim(uint8_t level_no, const cache_level_t *level, const block_t *b, uint64_t index, uint64_t pa) {
+    if (!b->valid) return;
+    uint64_t victim_pa = reconstruct_pa_from_tag_index(level, b->tag, index);
+    event_log_record(level_no, b->dirty ? EVENT_WRITEBACK : EVENT_EVICT, b->dirty ? EVENT_FLAG_DIRTY : 0,
+                     block_address(level, pa), victim_pa, 1);
+}
+
+static void invalidate_L1_block_if_present(uint64_t pa) {
     if (cache_level != 2) return;
-    int num_blocks = L1_cache_size / L1_cache_block_size;
-    int num_sets = num_blocks / L1_cache_associativity;
-    if (num_sets == 0) num_sets = 1;
-    uint32_t index, tag, off_bits, idx_bits;
-    compute_L1_parts(pa, &index, &tag, &off_bits, &idx_bits, (uint32_t)num_sets);
+    uint64_t index, tag;
+    compute_parts(&L1, pa, &index, &tag);
+    set_ref_t set;
+    if (!peek_set_ref(&L1, pa, index, &set)) return;
     for (int way = 0; way < (int)L1_cache_associativity; way++) {
-        if (cache[index][way]->valid && cache[index][way]->tag == tag) {
-            cache[index][way]->valid = false;
-            cache[index][way]->dirty = false;
-            L1_lru_info[index][way].lru_counter = 0;
+        if (PEEK_WAY(set, way).valid && PEEK_WAY(set, way).tag == tag) {
+            CACHE_EVENT(1, EVENT_BACK_INVALIDATE, WAY(set, way).dirty ? EVENT_FLAG_DIRTY : 0, block_address(&L1, pa), 0, 1);
+            WAY(set, way).valid = false;
+            WAY(set, way).dirty = false;
+            WAY(set, way).sector_valid = 0;
+            WAY(set, way).sector_dirty = 0;
+            WAY(set, way).lru_counter = 0;
         }
     }
 }
 
 
-void initialize_cache() { 
-    int num_blocks = 0;
-    int num_sets = 0;
-    if (L1_cache_block_size != 0 && L1_cache_associativity != 0) {
-        num_blocks = L1_cache_size / L1_cache_block_size;
-        num_sets = num_blocks / L1_cache_associativity;
-    }
-    if (num_sets == 0) num_sets = 1;
-
-    cache = malloc(num_sets * sizeof(block_t**));
-    L1_lru_info = malloc(num_sets * sizeof(lru_info_t*)); 
-    for (int i = 0; i < num_sets; i++) {
-        cache[i] = malloc(L1_cache_associativity * sizeof(block_t*));
-        L1_lru_info[i] = malloc(L1_cache_associativity * sizeof(lru_info_t)); 
-        for (int j = 0; j < L1_cache_associativity; j++) {
-            cache[i][j] = malloc(sizeof(block_t));
-            cache[i][j]->valid = false;
-            cache[i][j]->dirty = false;
-            cache[i][j]->tag = 0;
-
-            L1_lru_info[i][j].lru_counter = 0; 
-        }
-    }
+void initialize_cache() {
+    if (cache_sector_size == 0) cache_sector_size = L1_cache_block_size;
+    init_cache_level(&L1, L1_cache_size, L1_cache_block_size, L1_cache_associativity, L1_index_function);
 
     if (cache_level == 2) {
         L2_cache_size = L1_cache_size * 16;
         L2_cache_associativity = L1_cache_associativity;
         L2_cache_block_size = L1_cache_block_size;
-        
-        int L2_num_blocks = 0;
-        int L2_num_sets = 0;
-        if (L2_cache_block_size != 0 && L2_cache_associativity != 0) {
-            L2_num_blocks = L2_cache_size / L2_cache_block_size;
-            L2_num_sets = L2_num_blocks / L2_cache_associativity;
-        }
-        if (L2_num_sets == 0) L2_num_sets = 1;
-
-        L2_cache = malloc(L2_num_sets * sizeof(block_t**));
-        L2_lru_info = malloc(L2_num_sets * sizeof(lru_info_t*)); 
-        for (int i = 0; i < L2_num_sets; i++) {
-            L2_cache[i] = malloc(L2_cache_associativity * sizeof(block_t*));
-            L2_lru_info[i] = malloc(L2_cache_associativity * sizeof(lru_info_t)); 
-            for (int j = 0; j < L2_cache_associativity; j++) {
-                L2_cache[i][j] = malloc(sizeof(block_t));
-                L2_cache[i][j]->valid = false;
-                L2_cache[i][j]->dirty = false;
-                L2_cache[i][j]->tag = 0;
-                
-                L2_lru_info[i][j].lru_counter = 0; 
-            }
-        }
+
+        init_cache_level(&L2, L2_cache_size, L2_cache_block_size, L2_cache_associativity, L2_index_function);
     }
 
     global_time = 1;
+    zcache_relocations[0] = zcache_relocations[1] = 0;
+    memset(stride_table, 0, sizeof(stride_table));
 }
 
 void free_cache() {
-    int num_blocks = 0;
-    int num_sets = 0;
-    if (L1_cache_block_size != 0 && L1_cache_associativity != 0) {
-        num_blocks = L1_cache_size / L1_cache_block_size;
-        num_sets = num_blocks / L1_cache_associativity;
-    }
-    if (num_sets == 0) num_sets = 1;
-    
-    for (int i = 0; i < num_sets; i++) {
-        for (int j = 0; j < L1_cache_associativity; j++) {
-            free(cache[i][j]);
-        }
-        free(cache[i]);
-        free(L1_lru_info[i]);
-    }
-    free(cache);
-    free(L1_lru_info);
+    free_cache_level(&L1);
 
     if (cache_level == 2) {
-        int L2_num_blocks = 0;
-        int L2_num_sets = 0;
-        if (L2_cache_block_size != 0 && L2_cache_associativity != 0) {
-            L2_num_blocks = L2_cache_size / L2_cache_block_size;
-            L2_num_sets = L2_num_blocks / L2_cache_associativity;
-        }
-        if (L2_num_sets == 0) L2_num_sets = 1;
-        
-        for (int i = 0; i < L2_num_sets; i++) {
-            for (int j = 0; j < L2_cache_associativity; j++) {
-                free(L2_cache[i][j]);
-            }
-            free(L2_cache[i]);
-            free(L2_lru_info[i]);
-        }
-        free(L2_cache);
-        free(L2_lru_info);
+        free_cache_level(&L2);
     }
 }
 
-void update_lru(uint32_t index, uint32_t accessed_way) {
-    L1_lru_info[index][accessed_way].lru_counter = global_time++;
+void update_lru(const set_ref_t *set, uint32_t accessed_way) {
+    way_of(set, accessed_way)->lru_counter = global_time++;
 }
 
-void update_lru_L2(uint32_t index, uint32_t accessed_way) {
-    L2_lru_info[index][accessed_way].lru_counter = global_time++;
+void update_lru_L2(const set_ref_t *set, uint32_t accessed_way) {
+    way_of(set, accessed_way)->lru_counter = global_time++;
 }
 
-int find_lru_way(uint32_t index) {
+// ZCache replacement. Each block in a candidate slot may also live at its
+// own slot in every other way, so the occupants of those slots are
+// candidates too. When the least recently used of them wins, the block in
+// front of it moves into its slot and the victim is swapped into the
+// first-level slot, where the caller evicts it as usual.
+static int zcache_relocate(set_ref_t *set, int lru_way, uint64_t *relocations) {
+    cache_level_t *level = set->level;
+    const block_t *oldest = peek_way(set, lru_way);
+    const block_t *victim = NULL;
+    block_t *front = NULL;
+    uint64_t victim_index = 0;
+    uint32_t victim_way = 0;
+    int front_way = lru_way;
+
+    for (uint32_t way = 0; way < level->associativity && (victim == NULL || victim->valid); way++) {
+        block_t *b = way_of(set, way);
+        for (uint32_t other = 0; other < level->associativity; other++) {
+            if (other == way) continue;
+            set_ref_t slot_ref = { level, NULL, b->tag };
+            const block_t *slot = peek_way(&slot_ref, other);
+            if (!slot->valid || slot->lru_counter < oldest->lru_counter) {
+                oldest = slot;
+                front = b;
+                victim = slot;
+                victim_index = skew_index(level, b->tag, other);
+                victim_way = other;
+                front_way = way;
+                if (!slot->valid) break;
+            }
+        }
+    }
+    if (victim == NULL) return lru_way;
+
+    block_t *slot = &get_set(level, victim_index)[victim_way];
+    block_t moved = *front;
+    *front = *slot;
+    *slot = moved;
+    (*relocations)++;
+    return front_way;
+}
+
+int find_lru_way(set_ref_t *set) {
     int lru_way = -1;
-    uint32_t oldest_time = global_time + 1; // 初始化为未来时间
-    
+    uint64_t oldest_time = global_time + 1; // 初始化为未来时间
+
     for (int way = 0; way < L1_cache_associativity; way++) {
-        if (!cache[index][way]->valid) return way;
-        if (lru_way == -1 || L1_lru_info[index][way].lru_counter < oldest_time) {
-            oldest_time = L1_lru_info[index][way].lru_counter;
+        if (!PEEK_WAY(*set, way).valid) return way;
+        if (lru_way == -1 || PEEK_WAY(*set, way).lru_counter < oldest_time) {
+            oldest_time = WAY(*set, way).lru_counter;
             lru_way = way;
         }
     }
+    if (L1.index_function == INDEX_ZCACHE) return zcache_relocate(set, lru_way, &zcache_relocations[0]);
     return lru_way;
 }
 
-int find_lru_way_L2(uint32_t index) {
+int find_lru_way_L2(set_ref_t *set) {
     int empty_way = -1;
     for (int way = 0; way < L2_cache_associativity; way++) {
-        if (!L2_cache[index][way]->valid) return way;
-        if (empty_way == -1 || L2_lru_info[index][way].lru_counter < L2_lru_info[index][empty_way].lru_counter) {
+        if (!PEEK_WAY(*set, way).valid) return way;
+        if (empty_way == -1 || PEEK_WAY(*set, way).lru_counter < PEEK_WAY(*set, empty_way).lru_counter) {
             empty_way = way;
         }
     }
-    return (empty_way == -1) ? 0 : empty_way;
+    if (empty_way == -1) return 0;
+    if (L2.index_function == INDEX_ZCACHE) return zcache_relocate(set, empty_way, &zcache_relocations[1]);
+    return empty_way;
 }
 
-void prefetch_block(uint32_t pa) {
-    if (prefetch_policy != PREFETCH_SEQ) return;
-    if (cache_level != 2) return;
+// Find the way of set that holds tag, or free one for it: the LRU block is
+// evicted, its dirty sectors written back to memory and its L1 copy
+// invalidated. A freed way holds tag with no valid sectors.
+static int fill_way_L2(set_ref_t *set, uint64_t index, uint64_t tag, uint64_t pa) {
+    for (int way = 0; way < (int)L2_cache_associativity; way++) {
+        if (PEEK_WAY(*set, way).valid && PEEK_WAY(*set, way).tag == tag) return way;
+    }
+
+    int replace_way = find_lru_way_L2(set);
+    block_t *b = &WAY(*set, replace_way);
+    if (event_log_active) log_victim(2, &L2, b, index, pa);
+    if (b->valid && b->dirty) {
+        PC_STATS_WRITEBACK();
+        uint64_t victim_pa = reconstruct_pa_from_tag_index(&L2, b->tag, index);
+        write_to_memory(victim_pa, sector_bytes(b->sector_dirty));
+        invalidate_L1_block_if_present(victim_pa);
+    }
+    b->valid = true;
+    b->tag = tag;
+    b->dirty = false;
+    b->sector_valid = 0;
+    b->sector_dirty = 0;
+    return replace_way;
+}
 
-    uint32_t next_pa = pa + L1_cache_block_size; 
+// Same for the L1, whose dirty victims go to the L2 when there is one.
+static int fill_way_L1(set_ref_t *set, uint64_t index, uint64_t tag, uint64_t pa) {
+    for (int way = 0; way < (int)L1_cache_associativity; way++) {
+        if (PEEK_WAY(*set, way).valid && PEEK_WAY(*set, way).tag == tag) return way;
+    }
 
-    int L2_num_blocks = L2_cache_size / L2_cache_block_size;
-    int L2_num_sets = L2_num_blocks / L2_cache_associativity;
-    if (L2_num_sets == 0) L2_num_sets = 1;
+    int replace_way = find_lru_way(set);
+    block_t *b = &WAY(*set, replace_way);
+    if (event_log_active) log_victim(1, &L1, b, index, pa);
+    if (b->valid && b->dirty) {
+        PC_STATS_WRITEBACK();
+        uint64_t victim_pa = reconstruct_pa_from_tag_index(&L1, b->tag, index);
+        if (cache_level == 2) {
+            write_to_L2_cache(victim_pa, b->sector_dirty);
+        } else {
+            write_to_memory(victim_pa, sector_bytes(b->sector_dirty));
+        }
+    }
+    b->valid = true;
+    b->tag = tag;
+    b->dirty = false;
+    b->sector_valid = 0;
+    b->sector_dirty = 0;
+    return replace_way;
+}
 
-    uint32_t L2_index, L2_tag, off_b, idx_b;
-    compute_L2_parts(next_pa, &L2_index, &L2_tag, &off_b, &idx_b, (uint32_t)L2_num_sets);
+// Bring the sector holding next_pa into the L2 unless it is already there.
+static void prefetch_into_L2(uint64_t next_pa) {
+    uint64_t L2_index, L2_tag;
+    compute_parts(&L2, next_pa, &L2_index, &L2_tag);
+    set_ref_t set = get_set_ref(&L2, next_pa, L2_index);
+    uint32_t sector = sector_mask(&L2, next_pa);
 
     for (int way = 0; way < (int)L2_cache_associativity; way++) {
-        if (L2_cache[L2_index][way]->valid && L2_cache[L2_index][way]->tag == L2_tag) {
-            update_lru_L2(L2_index, way);
+        if (PEEK_WAY(set, way).valid && PEEK_WAY(set, way).tag == L2_tag && (PEEK_WAY(set, way).sector_valid & sector)) {
+            update_lru_L2(&set, way);
             return;
         }
     }
 
-    memory_total_accesses++;
-    memory_read_accesses++;
+    read_from_memory(next_pa, cache_sector_size);
+    CACHE_EVENT(2, EVENT_PREFETCH_FILL, 0, block_address(&L2, next_pa), 0, 1);
 
-    int replace_way = find_lru_way_L2(L2_index);
+    int replace_way = fill_way_L2(&set, L2_index, L2_tag, next_pa);
+    WAY(set, replace_way).sector_valid |= sector;
+    WAY(set, replace_way).lru_counter = global_time++;
+}
 
-    if (L2_cache[L2_index][replace_way]->valid && L2_cache[L2_index][replace_way]->dirty) {
-        memory_total_accesses++;
-        memory_write_accesses++;
-        uint32_t victim_pa = reconstruct_pa_from_tag_index(L2_cache[L2_index][replace_way]->tag, L2_index, off_b, idx_b);
-        invalidate_L1_block_if_present(victim_pa);
+void prefetch_block(uint64_t pa) {
+    if (prefetch_policy != PREFETCH_SEQ) return;
+    if (cache_level != 2) return;
+
+    prefetch_into_L2(pa + cache_sector_size);
+}
+
+// Called after every demand access for prefetchers that train on the whole
+// access stream rather than on L1 misses. Repeated accesses to the last
+// block of an entry carry no stride information and are ignored, which also
+// keeps coalesced runs exact.
+void prefetch_on_access(uint64_t pa, uint64_t pc) {
+    if (prefetch_policy != PREFETCH_STR) return;
+
+    uint64_t key = pc != 0 ? pc : ~(pa >> STRIDE_REGION_SHIFT);
+    uint64_t block = pa >> L1.offset_bits;
+    stride_entry_t *e = &stride_table[(key * 0x9E3779B97F4A7C15ULL) >> (64 - STRIDE_TABLE_BITS)];
+
+    if (!e->valid || e->key != key) {
+        e->valid = true;
+        e->key = key;
+        e->last_block = block;
+        e->stride = 0;
+        e->confidence = 0;
+        return;
     }
+    if (block == e->last_block) return;
 
-    L2_cache[L2_index][replace_way]->valid = true;
-    L2_cache[L2_index][replace_way]->tag = L2_tag;
-    L2_cache[L2_index][replace_way]->dirty = false;
-    L2_lru_info[L2_index][replace_way].lru_counter = global_time++;
+    int64_t stride = (int64_t)(block - e->last_block);
+    if (stride == e->stride) {
+        if (e->confidence < STRIDE_CONFIDENCE_MAX) e->confidence++;
+    } else if (e->confidence > 0) {
+        e->confidence--;
+    } else {
+        e->stride = stride;
+    }
+    e->last_block = block;
+
+    if (e->confidence >= STRIDE_CONFIDENCE_ISSUE && cache_level == 2) {
+        prefetch_into_L2(pa + ((uint64_t)e->stride << L1.offset_bits));
+    }
 }
 
 
-int read_from_L2_cache_real(uint32_t pa) {
+int read_from_L2_cache_real(uint64_t pa) {
     L2_cache_total_accesses++;
     L2_cache_read_accesses++;
 
-    int L2_num_blocks = 0;
-    int L2_num_sets = 0;
-    if (L2_cache_block_size != 0 && L2_cache_associativity != 0) {
-        L2_num_blocks = L2_cache_size / L2_cache_block_size;
-        L2_num_sets = L2_num_blocks / L2_cache_associativity;
-    }
-    if (L2_num_sets == 0) L2_num_sets = 1;
-
-    uint32_t index, tag, off_b, idx_b;
-    compute_L2_parts(pa, &index, &tag, &off_b, &idx_b, (uint32_t)L2_num_sets);
+    uint64_t index, tag;
+    compute_parts(&L2, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L2, pa, index);
+    uint32_t sector = sector_mask(&L2, pa);
 
     for (int way = 0; way < (int)L2_cache_associativity; way++) {
-        if (L2_cache[index][way]->valid && L2_cache[index][way]->tag == tag) {
-            update_lru_L2(index, way);
+        if (PEEK_WAY(set, way).valid && PEEK_WAY(set, way).tag == tag && (PEEK_WAY(set, way).sector_valid & sector)) {
+            update_lru_L2(&set, way);
             L2_cache_hits++;
             L2_cache_read_hits++;
-            return 1; 
+            CACHE_EVENT(2, EVENT_HIT, 0, block_address(&L2, pa), 0, 1);
+            return 1;
         }
     }
-    
+
     L2_cache_misses++;
+    INTERVAL_MISS(2, index);
+    PC_STATS_MISS(2);
+    CACHE_EVENT(2, EVENT_MISS, 0, block_address(&L2, pa), 0, 1);
     return 0;
 }
 
-int write_to_L2_cache_real(uint32_t pa) {
+int write_to_L2_cache_real(uint64_t pa, uint32_t sectors) {
     L2_cache_total_accesses++;
     L2_cache_write_accesses++;
 
-    int L2_num_blocks = 0;
-    int L2_num_sets = 0;
-    if (L2_cache_block_size != 0 && L2_cache_associativity != 0) {
-        L2_num_blocks = L2_cache_size / L2_cache_block_size;
-        L2_num_sets = L2_num_blocks / L2_cache_associativity;
-    }
-    if (L2_num_sets == 0) L2_num_sets = 1;
-
-    uint32_t index, tag, off_b, idx_b;
-    compute_L2_parts(pa, &index, &tag, &off_b, &idx_b, (uint32_t)L2_num_sets);
+    uint64_t index, tag;
+    compute_parts(&L2, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L2, pa, index);
 
     for (int way = 0; way < (int)L2_cache_associativity; way++) {
-        if (L2_cache[index][way]->valid && L2_cache[index][way]->tag == tag) {
-            L2_cache[index][way]->dirty = true;
-            update_lru_L2(index, way);
+        if (PEEK_WAY(set, way).valid && PEEK_WAY(set, way).tag == tag) {
+            WAY(set, way).dirty = true;
+            WAY(set, way).sector_valid |= sectors;
+            WAY(set, way).sector_dirty |= sectors;
+            update_lru_L2(&set, way);
             L2_cache_hits++;
             L2_cache_write_hits++;
+            CACHE_EVENT(2, EVENT_HIT, EVENT_FLAG_WRITE, block_address(&L2, pa), 0, 1);
             return 1;
         }
     }
 
     L2_cache_misses++;
-    int replace_way = find_lru_way_L2(index);
+    INTERVAL_MISS(2, index);
+    PC_STATS_MISS(2);
+    CACHE_EVENT(2, EVENT_MISS, EVENT_FLAG_WRITE, block_address(&L2, pa), 0, 1);
 
-    if (L2_cache[index][replace_way]->valid && L2_cache[index][replace_way]->dirty) {
-        memory_total_accesses++;
-        memory_write_accesses++;
-        uint32_t victim_pa = reconstruct_pa_from_tag_index(L2_cache[index][replace_way]->tag, index, off_b, idx_b);
-        invalidate_L1_block_if_present(victim_pa);
-    }
+    int replace_way = fill_way_L2(&set, index, tag, pa);
+    WAY(set, replace_way).dirty = true;
+    WAY(set, replace_way).sector_valid = sectors;
+    WAY(set, replace_way).sector_dirty = sectors;
+    WAY(set, replace_way).lru_counter = global_time++;
 
-    L2_cache[index][replace_way]->valid = true;
-    L2_cache[index][replace_way]->tag = tag;
-    L2_cache[index][replace_way]->dirty = true;
-    L2_lru_info[index][replace_way].lru_counter = global_time++;
-    
-    return 0; 
-}
-
-void install_to_L2_cache(uint32_t pa) {
-    int L2_num_blocks = L2_cache_size / L2_cache_block_size;
-    int L2_num_sets = L2_num_blocks / L2_cache_associativity;
-    if (L2_num_sets == 0) L2_num_sets = 1;
-    
-    uint32_t index, tag, off_b, idx_b;
-    compute_L2_parts(pa, &index, &tag, &off_b, &idx_b, (uint32_t)L2_num_sets);
-    
-    int replace_way = find_lru_way_L2(index);
-    if (L2_cache[index][replace_way]->valid && L2_cache[index][replace_way]->dirty) {
-        memory_total_accesses++;
-        memory_write_accesses++;
-        uint32_t victim_pa = reconstruct_pa_from_tag_index(L2_cache[index][replace_way]->tag, index, off_b, idx_b);
-        invalidate_L1_block_if_present(victim_pa);
-    }
-    L2_cache[index][replace_way]->valid = true;
-    L2_cache[index][replace_way]->tag = tag;
-    L2_cache[index][replace_way]->dirty = false; 
-    L2_lru_info[index][replace_way].lru_counter = global_time++;
-    
-    update_lru_L2(index, replace_way);
+    return 0;
 }
 
+// Install the sector holding pa, just read from memory, into the L2.
+void install_to_L2_cache(uint64_t pa) {
+    uint64_t index, tag;
+    compute_parts(&L2, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L2, pa, index);
 
-op_result_t read_from_cache(uint32_t pa) {
-    L1_cache_total_accesses++;
-    L1_cache_read_accesses++;
+    int replace_way = fill_way_L2(&set, index, tag, pa);
+    WAY(set, replace_way).sector_valid |= sector_mask(&L2, pa);
+    WAY(set, replace_way).lru_counter = global_time++;
+
+    update_lru_L2(&set, replace_way);
+}
 
-    int num_blocks = 0;
-    int num_sets = 0;
-    if (L1_cache_block_size != 0 && L1_cache_associativity != 0) {
-        num_blocks = L1_cache_size / L1_cache_block_size;
-        num_sets = num_blocks / L1_cache_associativity;
+// Bring the sector holding pa into the L1 on a miss, through the L2 when
+// there is one. Only the missing sector is fetched. Returns its way.
+static int fetch_into_L1(set_ref_t *set, uint64_t index, uint64_t tag, uint64_t pa) {
+    if (prefetch_policy != PREFETCH_NONE) {
+        prefetch_block(pa);
     }
-    if (num_sets == 0) num_sets = 1;
 
-    uint32_t index, tag, off_b, idx_b;
-    compute_L1_parts(pa, &index, &tag, &off_b, &idx_b, (uint32_t)num_sets);
+    if (cache_level == 2) {
+        if (!read_from_L2_cache(pa)) {
+            read_from_memory(pa, cache_sector_size);
+            install_to_L2_cache(pa);
+        }
+    } else {
+        read_from_memory(pa, cache_sector_size);
+    }
 
-    bool hit = false;
-    int hit_way = -1;
+    int way = fill_way_L1(set, index, tag, pa);
+    WAY(*set, way).sector_valid |= sector_mask(&L1, pa);
+    WAY(*set, way).lru_counter = global_time++;
+    update_lru(set, way);
+    return way;
+}
+
+// A hit needs both the tag and the sector of pa; a present tag with a
+// missing sector is a (sector) miss that does not evict anything.
+static int find_L1_way(set_ref_t *set, uint64_t tag, uint64_t pa) {
+    uint32_t sector = sector_mask(&L1, pa);
     for (int way = 0; way < (int)L1_cache_associativity; way++) {
-        if (cache[index][way]->valid && cache[index][way]->tag == tag) {
-            hit = true;
-            hit_way = way;
-            break;
+        if (PEEK_WAY(*set, way).valid && PEEK_WAY(*set, way).tag == tag) {
+            return (PEEK_WAY(*set, way).sector_valid & sector) ? way : -1;
         }
     }
+    return -1;
+}
 
-    if (hit) {
-        update_lru(index, hit_way);
+op_result_t read_from_cache(uint64_t pa) {
+    L1_cache_total_accesses++;
+    L1_cache_read_accesses++;
+
+    uint64_t index, tag;
+    compute_parts(&L1, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L1, pa, index);
+
+    int hit_way = find_L1_way(&set, tag, pa);
+    if (hit_way >= 0) {
+        update_lru(&set, hit_way);
         L1_cache_hits++;
         L1_cache_read_hits++;
+        CACHE_EVENT(1, EVENT_HIT, 0, block_address(&L1, pa), 0, 1);
         return HIT;
-    } else {
-        L1_cache_misses++;
-
-        if(prefetch_policy!=PREFETCH_NONE){
-            prefetch_block(pa);
-        }
-
-        if (cache_level == 2) {
-            if (read_from_L2_cache(pa)) {
-                int replace_way = find_lru_way(index);
-
-                if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                    uint32_t victim_pa = reconstruct_pa_from_tag_index(cache[index][replace_way]->tag, index, off_b, idx_b);
-                    write_to_L2_cache(victim_pa);
-                }
-
-                cache[index][replace_way]->valid = true;
-                cache[index][replace_way]->tag = tag;
-                cache[index][replace_way]->dirty = false;
-                L1_lru_info[index][replace_way].lru_counter = global_time++;
-                update_lru(index, replace_way);
-            } else {
-                memory_total_accesses++;
-                memory_read_accesses++;
-
-                install_to_L2_cache(pa);
-
-                int replace_way = find_lru_way(index);
-                if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                    uint32_t victim_pa = reconstruct_pa_from_tag_index(cache[index][replace_way]->tag, index, off_b, idx_b);
-                    write_to_L2_cache(victim_pa);
-                }
-
-                cache[index][replace_way]->valid = true;
-                cache[index][replace_way]->tag = tag;
-                cache[index][replace_way]->dirty = false;
-                L1_lru_info[index][replace_way].lru_counter = global_time++;
-                update_lru(index, replace_way);
-            }
-        } else {
-            memory_total_accesses++;
-            memory_read_accesses++;
+    }
 
-            int replace_way = find_lru_way(index);
-            if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                memory_total_accesses++;
-                memory_write_accesses++;
-            }
+    L1_cache_misses++;
+    INTERVAL_MISS(1, index);
+    PC_STATS_MISS(1);
+    CACHE_EVENT(1, EVENT_MISS, 0, block_address(&L1, pa), 0, 1);
 
-            cache[index][replace_way]->valid = true;
-            cache[index][replace_way]->tag = tag;
-            cache[index][replace_way]->dirty = false;
-            L1_lru_info[index][replace_way].lru_counter = global_time++;
-            update_lru(index, replace_way);
-        }
-        return MISS;
-    }
+    fetch_into_L1(&set, index, tag, pa);
+    return MISS;
 }
 
-op_result_t write_to_cache(uint32_t pa) {
+op_result_t write_to_cache(uint64_t pa) {
     L1_cache_total_accesses++;
     L1_cache_write_accesses++;
 
-    int num_blocks = 0;
-    int num_sets = 0;
-    if (L1_cache_block_size != 0 && L1_cache_associativity != 0) {
-        num_blocks = L1_cache_size / L1_cache_block_size;
-        num_sets = num_blocks / L1_cache_associativity;
-    }
-    if (num_sets == 0) num_sets = 1;
-
-    uint32_t index, tag, off_b, idx_b;
-    compute_L1_parts(pa, &index, &tag, &off_b, &idx_b, (uint32_t)num_sets);
-
-    bool hit = false;
-    int hit_way = -1;
-    for (int way = 0; way < (int)L1_cache_associativity; way++) {
-        if (cache[index][way]->valid && cache[index][way]->tag == tag) {
-            hit = true;
-            hit_way = way;
-            break;
-        }
-    }
+    uint64_t index, tag;
+    compute_parts(&L1, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L1, pa, index);
+    uint32_t sector = sector_mask(&L1, pa);
 
-    if (hit) {
-        cache[index][hit_way]->dirty = true;
-        update_lru(index, hit_way);
+    int hit_way = find_L1_way(&set, tag, pa);
+    if (hit_way >= 0) {
+        WAY(set, hit_way).dirty = true;
+        WAY(set, hit_way).sector_dirty |= sector;
+        update_lru(&set, hit_way);
         L1_cache_hits++;
         L1_cache_write_hits++;
+        CACHE_EVENT(1, EVENT_HIT, EVENT_FLAG_WRITE, block_address(&L1, pa), 0, 1);
         return HIT;
-    } else {
-        L1_cache_misses++;
+    }
 
-        if(prefetch_policy!=PREFETCH_NONE){
-            prefetch_block(pa);
-        }
+    L1_cache_misses++;
+    INTERVAL_MISS(1, index);
+    PC_STATS_MISS(1);
+    CACHE_EVENT(1, EVENT_MISS, EVENT_FLAG_WRITE, block_address(&L1, pa), 0, 1);
 
-        if (cache_level == 2) {
-            if (read_from_L2_cache(pa)) {
-                int replace_way = find_lru_way(index);
-               
-                if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                    uint32_t victim_pa = reconstruct_pa_from_tag_index(cache[index][replace_way]->tag, index, off_b, idx_b);
-                    write_to_L2_cache(victim_pa);
-                }
-                cache[index][replace_way]->valid = true;
-                cache[index][replace_way]->tag = tag;
-                cache[index][replace_way]->dirty = true;
-                L1_lru_info[index][replace_way].lru_counter = global_time++;
-                update_lru(index, replace_way);
-
-            } else {
-                memory_total_accesses++;
-                memory_read_accesses++;
-                install_to_L2_cache(pa);
-
-                int replace_way = find_lru_way(index);
-                if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                    uint32_t victim_pa = reconstruct_pa_from_tag_index(cache[index][replace_way]->tag, index, off_b, idx_b);
-                    write_to_L2_cache(victim_pa);
-                }
-
-                cache[index][replace_way]->valid = true;
-                cache[index][replace_way]->tag = tag;
-                cache[index][replace_way]->dirty = true;
-                L1_lru_info[index][replace_way].lru_counter = global_time++;
-                update_lru(index, replace_way);
-            }
-        } else {
-            int replace_way = find_lru_way(index);
-            if (cache[index][replace_way]->valid && cache[index][replace_way]->dirty) {
-                memory_total_accesses++;
-                memory_write_accesses++;
-            }
+    // Write-allocate: the sector is fetched and then written.
+    int way = fetch_into_L1(&set, index, tag, pa);
+    WAY(set, way).dirty = true;
+    WAY(set, way).sector_dirty |= sector;
+    return MISS;
+}
 
-            memory_total_accesses++;
-            memory_read_accesses++;
+uint64_t get_cache_num_sets(uint32_t level) {
+    return level == 2 ? L2.num_sets : L1.num_sets;
+}
+
+// Credit follow-up accesses to the block that pa was just brought into. They
+// are L1 hits by construction, so only the counters, the dirty bit and the
+// MRU stamp change. The LRU clock advances as if each access ran on its own.
+// Returns 1 without crediting anything when the block is no longer in the
+// L1, which happens when a prefetch issued by the leading access evicted it.
+int credit_repeated_L1_hits(uint64_t pa, uint32_t repeat_reads, uint32_t repeat_writes) {
+    uint64_t repeats = (uint64_t)repeat_reads + repeat_writes;
+    if (repeats == 0) return 0;
 
-            cache[index][replace_way]->valid = true;
-            cache[index][replace_way]->tag = tag;
-            cache[index][replace_way]->dirty = true;
-            L1_lru_info[index][replace_way].lru_counter = global_time++;
-            update_lru(index, replace_way);
+    uint64_t index, tag;
+    compute_parts(&L1, pa, &index, &tag);
+    set_ref_t set = get_set_ref(&L1, pa, index);
+
+    for (int way = 0; way < (int)L1_cache_associativity; way++) {
+        if (PEEK_WAY(set, way).valid && PEEK_WAY(set, way).tag == tag) {
+            if (repeat_writes) {
+                WAY(set, way).dirty = true;
+                WAY(set, way).sector_dirty |= sector_mask(&L1, pa);
+            }
+            if (event_log_active) {
+                if (repeat_reads) event_log_record(1, EVENT_HIT, 0, block_address(&L1, pa), 0, repeat_reads);
+                if (repeat_writes) event_log_record(1, EVENT_HIT, EVENT_FLAG_WRITE, block_address(&L1, pa), 0, repeat_writes);
+            }
+            global_time += repeats - 1;
+            update_lru(&set, way);
+
+            L1_cache_total_accesses += repeats;
+            L1_cache_hits += repeats;
+            L1_cache_read_accesses += repeat_reads;
+            L1_cache_read_hits += repeat_reads;
+            L1_cache_write_accesses += repeat_writes;
+            L1_cache_write_hits += repeat_writes;
+            return 0;
         }
-        return MISS;
     }
+    return 1;
 }
 
 void print_cache_statistics() {
     printf("\n* Cache Statistics *\n");
-    printf("memory total accesses: %d\n", memory_total_accesses);
-    printf("memory read accesses: %d\n", memory_read_accesses);
-    printf("memory write accesses: %d\n", memory_write_accesses);
-
-    printf("L1 total accesses: %d\n", L1_cache_total_accesses);
-    printf("L1 hits: %d\n", L1_cache_hits);
-    printf("L1 misses: %d\n", L1_cache_misses);
-    printf("L1 total reads: %d\n", L1_cache_read_accesses);
-    printf("L1 read hits: %d\n", L1_cache_read_hits);
-    printf("L1 total writes: %d\n", L1_cache_write_accesses);
-    printf("L1 write hits: %d\n", L1_cache_write_hits);
+    printf("memory total accesses: %" PRIu64 "\n", memory_total_accesses);
+    printf("memory read accesses: %" PRIu64 "\n", memory_read_accesses);
+    printf("memory write accesses: %" PRIu64 "\n", memory_write_accesses);
+    printf("memory read bytes: %" PRIu64 "\n", memory_read_bytes);
+    printf("memory write bytes: %" PRIu64 "\n", memory_write_bytes);
+
+    printf("L1 total accesses: %" PRIu64 "\n", L1_cache_total_accesses);
+    printf("L1 hits: %" PRIu64 "\n", L1_cache_hits);
+    printf("L1 misses: %" PRIu64 "\n", L1_cache_misses);
+    printf("L1 total reads: %" PRIu64 "\n", L1_cache_read_accesses);
+    printf("L1 read hits: %" PRIu64 "\n", L1_cache_read_hits);
+    printf("L1 total writes: %" PRIu64 "\n", L1_cache_write_accesses);
+    printf("L1 write hits: %" PRIu64 "\n", L1_cache_write_hits);
+    if (L1_index_function == INDEX_ZCACHE) {
+        printf("L1 relocations: %" PRIu64 "\n", zcache_relocations[0]);
+    }
 
     if (cache_level == 2) {
-        printf("L2 total accesses: %d\n", L2_cache_total_accesses);
-        printf("L2 hits: %d\n", L2_cache_hits);
-        printf("L2 misses: %d\n", L2_cache_misses);
-        printf("L2 total reads: %d\n", L2_cache_read_accesses);
-        printf("L2 read hits: %d\n", L2_cache_read_hits);
-        printf("L2 total writes: %d\n", L2_cache_write_accesses);
-        printf("L2 write hits: %d\n", L2_cache_write_hits);
+        printf("L2 total accesses: %" PRIu64 "\n", L2_cache_total_accesses);
+        printf("L2 hits: %" PRIu64 "\n", L2_cache_hits);
+        printf("L2 misses: %" PRIu64 "\n", L2_cache_misses);
+        printf("L2 total reads: %" PRIu64 "\n", L2_cache_read_accesses);
+        printf("L2 read hits: %" PRIu64 "\n", L2_cache_read_hits);
+        printf("L2 total writes: %" PRIu64 "\n", L2_cache_write_accesses);
+        printf("L2 write hits: %" PRIu64 "\n", L2_cache_write_hits);
+        if (L2_index_function == INDEX_ZCACHE) {
+            printf("L2 relocations: %" PRIu64 "\n", zcache_relocations[1]);
+        }
     }
 }
 
 int process_arg_S(int opt, char *optarg) {
-    L1_cache_size = atoi(optarg);
-    if (L1_cache_size <= 0) return 1;
+    char *end = NULL;
+    L1_cache_size = strtoull(optarg, &end, 10);
+    if (end == optarg || *end != '\0') return 1;
+    if (L1_cache_size == 0) return 1;
     if ((L1_cache_size & (L1_cache_size - 1)) != 0) return 1;
     return 0;
 }
 
-int process_arg_A(int opt, char *optarg) { 
-    L1_cache_associativity = atoi(optarg); 
-    return 0; 
+int process_arg_A(int opt, char *optarg) {
+    L1_cache_associativity = atoi(optarg);
+    return 0;
 }
 
-int process_arg_B(int opt, char *optarg) { 
-    L1_cache_block_size = atoi(optarg); 
-    return 0; 
+int process_arg_B(int opt, char *optarg) {
+    L1_cache_block_size = atoi(optarg);
+    return 0;
 }
 
-int process_arg_L(int opt, char *optarg) { 
-    cache_level = atoi(optarg); 
-    return 0; 
+int process_arg_L(int opt, char *optarg) {
+    cache_level = atoi(optarg);
+    return 0;
 }
 
-int process_arg_P(int opt, char *optarg) { 
+int process_arg_P(int opt, char *optarg) {
     if (strcmp(optarg, "none") == 0) {
         prefetch_policy = PREFETCH_NONE;
     } else if (strcmp(optarg, "SEQ") == 0) {
@@ -637,8 +906,76 @@ int process_arg_P(int opt, char *optarg) {
     return 0;
 }
 
-static int is_power_of_two(uint32_t x) {
-    return x != 0 && ((x & (x - 1)) == 0);
+static int parse_index_function(const char *name, index_function_t *fn) {
+    if (strcmp(name, "mod") == 0) {
+        *fn = INDEX_MODULO;
+    } else if (strcmp(name, "xor") == 0) {
+        *fn = INDEX_XOR;
+    } else if (strcmp(name, "prime") == 0) {
+        *fn = INDEX_PRIME;
+    } else if (strcmp(name, "skew") == 0) {
+        *fn = INDEX_SKEW;
+    } else if (strcmp(name, "zcache") == 0) {
+        *fn = INDEX_ZCACHE;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+// -H takes one index function for both levels, or per-level settings:
+//   mod|xor|prime|skew|zcache
+//   L1=<function>[,L2=<function>]
+int process_arg_H(int opt, char *optarg) {
+    if (strchr(optarg, '=') == NULL) {
+        if (parse_index_function(optarg, &L1_index_function)) return 1;
+        L2_index_function = L1_index_function;
+        return 0;
+    }
+
+    char *save = NULL;
+    for (char *tok = strtok_r(optarg, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (val == NULL) return 1;
+        *val++ = '\0';
+        if (strcmp(tok, "L1") == 0) {
+            if (parse_index_function(val, &L1_index_function)) return 1;
+        } else if (strcmp(tok, "L2") == 0) {
+            if (parse_index_function(val, &L2_index_function)) return 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// -G splits every block into sectors of the given size that are fetched,
+// validated and written back individually. The default is one sector per
+// block.
+int process_arg_G(int opt, char *optarg) {
+    char *end = NULL;
+    unsigned long n = strtoul(optarg, &end, 10);
+    if (end == optarg || *end != '\0' || n == 0 || n > UINT32_MAX) return 1;
+    cache_sector_size = (uint32_t)n;
+    return 0;
+}
+
+int process_arg_C(int opt, char *optarg) {
+    checkpoint_save_file = optarg;
+    return 0;
+}
+
+int process_arg_R(int opt, char *optarg) {
+    checkpoint_restore_file = optarg;
+    return 0;
+}
+
+int process_arg_K(int opt, char *optarg) {
+    char *end = NULL;
+    unsigned long long n = strtoull(optarg, &end, 10);
+    if (end == optarg || *end != '\0' || n == 0) return 1;
+    checkpoint_at_access = (uint64_t)n;
+    return 0;
 }
 
 int check_cache_parameters_valid() {
@@ -646,15 +983,22 @@ int check_cache_parameters_valid() {
     if (L1_cache_block_size == 0) return -1;
     if (L1_cache_associativity == 0) return -1;
 
-    if (L1_cache_size < 4 || L1_cache_size > 16384 || !is_power_of_two(L1_cache_size)) return -1;
+    // The L2 is sixteen times the L1 and has to stay addressable.
+    if (L1_cache_size < 4 || L1_cache_size > (1ULL << 58) || !is_power_of_two(L1_cache_size)) return -1;
 
     if (L1_cache_block_size < 4 || L1_cache_block_size > L1_cache_size || !is_power_of_two(L1_cache_block_size)) return -1;
 
     if (L1_cache_size % L1_cache_block_size != 0) return -1;
 
-    int total_blocks = L1_cache_size / L1_cache_block_size;
+    uint64_t total_blocks = L1_cache_size / L1_cache_block_size;
     if (L1_cache_associativity > total_blocks || !is_power_of_two(L1_cache_associativity)) return -1;
 
+    // Sector masks are one 32-bit word per block.
+    if (cache_sector_size != 0) {
+        if (cache_sector_size < 4 || cache_sector_size > L1_cache_block_size || !is_power_of_two(cache_sector_size)) return -1;
+        if (L1_cache_block_size / cache_sector_size > 32) return -1;
+    }
+
     return 0;
 }
 
@@ -663,3 +1007,186 @@ void handle_cache_verbose(memory_access_entry_t entry, op_result_t ret) {
         printf("This message should not be printed. Fix your code\n");
     }
 }
+
+static uint64_t *checkpoint_counters[CHECKPOINT_NUM_COUNTERS] = {
+    &L1_cache_total_accesses, &L1_cache_hits, &L1_cache_misses,
+    &L1_cache_read_accesses, &L1_cache_read_hits,
+    &L1_cache_write_accesses, &L1_cache_write_hits,
+    &L2_cache_total_accesses, &L2_cache_hits, &L2_cache_misses,
+    &L2_cache_read_accesses, &L2_cache_read_hits,
+    &L2_cache_write_accesses, &L2_cache_write_hits,
+    &memory_total_accesses, &memory_read_accesses, &memory_write_accesses,
+    &memory_read_bytes, &memory_write_bytes
+};
+
+void reset_cache_statistics() {
+    for (int i = 0; i < CHECKPOINT_NUM_COUNTERS; i++) {
+        *checkpoint_counters[i] = 0;
+    }
+}
+
+static uint64_t count_valid_blocks(const cache_level_t *level) {
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < level->num_sets; i++) {
+        const block_t *set = peek_set(level, i);
+        if (set == NULL) {
+            i |= CACHE_SET_PAGE_SETS - 1;
+            continue;
+        }
+        for (uint32_t j = 0; j < level->associativity; j++) {
+            if (set[j].valid) n++;
+        }
+    }
+    return n;
+}
+
+static int write_checkpoint_level(FILE *fp, const cache_level_t *level) {
+    for (uint64_t i = 0; i < level->num_sets; i++) {
+        const block_t *set = peek_set(level, i);
+        if (set == NULL) {
+            i |= CACHE_SET_PAGE_SETS - 1;
+            continue;
+        }
+        for (uint32_t j = 0; j < level->associativity; j++) {
+            if (!set[j].valid) continue;
+            checkpoint_block_t rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.tag = set[j].tag;
+            rec.lru_counter = set[j].lru_counter;
+            rec.index = i;
+            rec.way = j;
+            if (set[j].dirty) rec.flags |= CHECKPOINT_BLOCK_DIRTY;
+            rec.sector_valid = set[j].sector_valid;
+            rec.sector_dirty = set[j].sector_dirty;
+            if (fwrite(&rec, sizeof(rec), 1, fp) != 1) return -1;
+        }
+    }
+    return 0;
+}
+
+static const checkpoint_block_t *read_checkpoint_level(const checkpoint_block_t *rec, cache_level_t *level, uint64_t count) {
+    for (uint64_t n = 0; n < count; n++, rec++) {
+        if (rec->index >= level->num_sets || rec->way >= level->associativity) return NULL;
+        block_t *b = &get_set(level, rec->index)[rec->way];
+        b->tag = rec->tag;
+        b->valid = true;
+        b->dirty = (rec->flags & CHECKPOINT_BLOCK_DIRTY) != 0;
+        b->sector_valid = rec->sector_valid;
+        b->sector_dirty = rec->sector_dirty;
+        b->lru_counter = rec->lru_counter;
+    }
+    return rec;
+}
+
+// Write the full hierarchy state to path. access_count is the number of trace
+// accesses simulated so far and is only recorded for reference.
+int save_cache_checkpoint(const char *path, uint64_t access_count) {
+    checkpoint_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CHECKPOINT_MAGIC, sizeof(hdr.magic));
+    hdr.version = CHECKPOINT_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.cache_level = cache_level;
+    hdr.prefetch_policy = prefetch_policy;
+    hdr.L1_cache_size = L1_cache_size;
+    hdr.L1_cache_associativity = L1_cache_associativity;
+    hdr.L1_cache_block_size = L1_cache_block_size;
+    hdr.L2_cache_size = L2_cache_size;
+    hdr.L2_cache_associativity = L2_cache_associativity;
+    hdr.L2_cache_block_size = L2_cache_block_size;
+    hdr.tlb_enabled = tlb_enabled;
+    hdr.index_functions = L1_index_function | (L2_index_function << 8);
+    hdr.sector_size = cache_sector_size;
+    hdr.L1_valid_blocks = count_valid_blocks(&L1);
+    hdr.L2_valid_blocks = cache_level == 2 ? count_valid_blocks(&L2) : 0;
+    hdr.global_time = global_time;
+    hdr.access_count = access_count;
+    for (int i = 0; i < CHECKPOINT_NUM_COUNTERS; i++) {
+        hdr.counters[i] = *checkpoint_counters[i];
+    }
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) return -1;
+
+    int ret = 0;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ret = -1;
+    if (ret == 0) ret = write_checkpoint_level(fp, &L1);
+    if (ret == 0 && cache_level == 2) ret = write_checkpoint_level(fp, &L2);
+    if (ret == 0 && prefetch_policy == PREFETCH_STR && fwrite(stride_table, sizeof(stride_table), 1, fp) != 1) ret = -1;
+    if (ret == 0 && tlb_enabled) ret = write_tlb_checkpoint(fp);
+    if (fclose(fp) != 0) ret = -1;
+    return ret;
+}
+
+// Restore a checkpoint written by save_cache_checkpoint(). The cache must
+// already be initialized with the same configuration. Statistics counters are
+// left untouched so that the restored run only reports the measured region.
+int load_cache_checkpoint(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(checkpoint_header_t)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    // The block counts come from the file, so they are bounded by its size
+    // before they are used to compute anything.
+    const checkpoint_header_t *hdr = map;
+    uint64_t max_blocks = ((size_t)st.st_size - sizeof(checkpoint_header_t)) / sizeof(checkpoint_block_t);
+    if (memcmp(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->version != CHECKPOINT_VERSION
+        || hdr->header_size != sizeof(checkpoint_header_t)
+        || hdr->L1_valid_blocks > max_blocks
+        || hdr->L2_valid_blocks > max_blocks) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    size_t expected = sizeof(checkpoint_header_t)
+        + (hdr->L1_valid_blocks + hdr->L2_valid_blocks) * sizeof(checkpoint_block_t)
+        + (prefetch_policy == PREFETCH_STR ? sizeof(stride_table) : 0);
+
+    int ret = 0;
+    if (hdr->cache_level != cache_level
+        || hdr->L1_cache_size != L1_cache_size
+        || hdr->L1_cache_associativity != L1_cache_associativity
+        || hdr->L1_cache_block_size != L1_cache_block_size
+        || hdr->L2_cache_size != L2_cache_size
+        || hdr->L2_cache_associativity != L2_cache_associativity
+        || hdr->L2_cache_block_size != L2_cache_block_size
+        || hdr->prefetch_policy != (uint32_t)prefetch_policy
+        || hdr->tlb_enabled != (uint32_t)tlb_enabled
+        || hdr->index_functions != (uint32_t)(L1_index_function | (L2_index_function << 8))
+        || hdr->sector_size != cache_sector_size
+        || (size_t)st.st_size < expected
+        || (!tlb_enabled && (size_t)st.st_size != expected)) {
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        const checkpoint_block_t *rec = (const checkpoint_block_t *)(hdr + 1);
+        rec = read_checkpoint_level(rec, &L1, hdr->L1_valid_blocks);
+        if (rec != NULL && cache_level == 2) {
+            rec = read_checkpoint_level(rec, &L2, hdr->L2_valid_blocks);
+        }
+        if (rec == NULL) ret = -1;
+        global_time = hdr->global_time;
+        const uint8_t *p = (const uint8_t *)rec;
+        if (ret == 0 && prefetch_policy == PREFETCH_STR) {
+            memcpy(stride_table, p, sizeof(stride_table));
+            p += sizeof(stride_table);
+        }
+        if (ret == 0 && tlb_enabled) {
+            ret = read_tlb_checkpoint(p, (size_t)st.st_size - expected);
+        }
+    }
+
+    munmap(map, st.st_size);
+    return ret;
+}
@@ -11,54 +11,86 @@
 #include <stdbool.h>
 
 // Cache statistics counters.
-extern uint32_t L1_cache_total_accesses;
-extern uint32_t L1_cache_hits;
-extern uint32_t L1_cache_misses;
-extern uint32_t L1_cache_read_accesses;
-extern uint32_t L1_cache_read_hits;
-extern uint32_t L1_cache_write_accesses;
-extern uint32_t L1_cache_write_hits;
-extern uint32_t L2_cache_total_accesses;
-extern uint32_t L2_cache_hits;
-extern uint32_t L2_cache_misses;
-extern uint32_t L2_cache_read_accesses;
-extern uint32_t L2_cache_read_hits;
-extern uint32_t L2_cache_write_accesses;
-extern uint32_t L2_cache_write_hits;
-extern uint32_t memory_total_accesses;
-extern uint32_t memory_read_accesses;
-extern uint32_t memory_write_accesses;
+extern uint64_t L1_cache_total_accesses;
+extern uint64_t L1_cache_hits;
+extern uint64_t L1_cache_misses;
+extern uint64_t L1_cache_read_accesses;
+extern uint64_t L1_cache_read_hits;
+extern uint64_t L1_cache_write_accesses;
+extern uint64_t L1_cache_write_hits;
+extern uint64_t L2_cache_total_accesses;
+extern uint64_t L2_cache_hits;
+extern uint64_t L2_cache_misses;
+extern uint64_t L2_cache_read_accesses;
+extern uint64_t L2_cache_read_hits;
+extern uint64_t L2_cache_write_accesses;
+extern uint64_t L2_cache_write_hits;
+extern uint64_t memory_total_accesses;
+extern uint64_t memory_read_accesses;
+extern uint64_t memory_write_accesses;
+extern uint64_t memory_read_bytes;
+extern uint64_t memory_write_bytes;
+
+// Rough per-level latencies used to turn counters into simulated cycles.
+#define CYCLES_L1_ACCESS 4
+#define CYCLES_L2_ACCESS 12
+#define CYCLES_MEMORY_ACCESS 200
+
+typedef enum {
+    PREFETCH_NONE,
+    PREFETCH_SEQ,
+    PREFETCH_STR,
+    PREFETCH_CUSTOM
+} prefetch_policy_t;
 
 // Input parameters to control the cache.
 extern uint32_t cache_level;
-extern uint32_t L1_cache_size;
+extern uint64_t L1_cache_size;
 extern uint32_t L1_cache_associativity;
 extern uint32_t L1_cache_block_size;
-extern uint32_t L2_cache_size;
+extern uint64_t L2_cache_size;
 extern uint32_t L2_cache_associativity;
 extern uint32_t L2_cache_block_size;
+extern uint32_t cache_sector_size;
+extern prefetch_policy_t prefetch_policy;
+
+// Warm-start checkpoint parameters.
+extern char *checkpoint_save_file;
+extern char *checkpoint_restore_file;
+extern uint64_t checkpoint_at_access;
 
 void initialize_cache(void);
 void free_cache(void);
+void reset_cache_statistics(void);
 void print_cache_statistics(void);
 int check_cache_parameters_valid(void);
 
-op_result_t read_from_cache(uint32_t pa);
-op_result_t write_to_cache(uint32_t pa);
+op_result_t read_from_cache(uint64_t pa);
+op_result_t write_to_cache(uint64_t pa);
+uint64_t get_cache_num_sets(uint32_t level);
+void prefetch_on_access(uint64_t pa, uint64_t pc);
+int credit_repeated_L1_hits(uint64_t pa, uint32_t repeat_reads, uint32_t repeat_writes);
+
+// Only PREFETCH_STR trains on every access; the check is inline so the other
+// policies do not pay for a call per record.
+#define PREFETCH_ON_ACCESS(pa, pc)                                                \
+    do {                                                                          \
+        if (prefetch_policy == PREFETCH_STR) prefetch_on_access((pa), (pc));      \
+    } while (0)
+
+int save_cache_checkpoint(const char *path, uint64_t access_count);
+int load_cache_checkpoint(const char *path);
 
 int process_arg_S(int opt, char *optarg);
 int process_arg_A(int opt, char *optarg);
 int process_arg_B(int opt, char *optarg);
 int process_arg_L(int opt, char *optarg);
 int process_arg_P(int opt, char *optarg);
+int process_arg_H(int opt, char *optarg);
+int process_arg_G(int opt, char *optarg);
+int process_arg_C(int opt, char *optarg);
+int process_arg_R(int opt, char *optarg);
+int process_arg_K(int opt, char *optarg);
 void handle_cache_verbose(memory_access_entry_t entry, op_result_t ret);
 
-typedef struct {
-  bool valid;
-  uint32_t tag;
-  bool dirty;
-} block_t;
-
-extern block_t ***cache;
-
 #endif /* CACHE_H_ */
@@ -5,41 +5,34 @@
 */
 
 #include "common.h"
+#include "tlb.h"
 
+/*
+ * The simulator is built from every source file except the standalone tools
+ * (bench.c, evdecode.c, simclient.c), which carry their own build lines:
+ *   cc -O2 -o sim main.c cache.c common.c dram.c eventlog.c interval.c \
+ *       pcstats.c server.c tlb.c trace.c -lpthread -lm
+ */
 char *usage_str =
-    "Usage: ./sim -t <trace_file> [-v] [-S <S>] [-B <B>] [-A <A>] [-L <L>]";
+    "Usage: ./sim -t <trace_file> [-v] [-S <S>] [-B <B>] [-A <A>] [-L <L>]"
+    " [-P <P>] [-H <index_function>] [-G <sector_size>]"
+    " [-C <checkpoint_out>] [-R <checkpoint_in>] [-K <N>]"
+    " [-F] [-W <binary_trace_out>]"
+    " [-T <tlb_config>] [-E <event_log>[,sample=N][,range=lo:hi]]"
+    " [-I <interval_out>[,every=N][,unit=accesses|cycles][,format=csv|jsonl]"
+    "[,heat=bins][,phase=threshold]] [-D <socket_path>] [-M <top_pcs>]"
+    " [-X <dram_config>]";
 
 // Input parameters.
 uint32_t verbose = 0;
 char *trace_file = NULL;
+uint32_t coalesce_accesses = 0;
+char *binary_trace_out = NULL;
 
-// Read one entry at a time from the trace file.
-memory_access_entry_t process_trace_file_line(FILE *trace_fp) {
-  memory_access_entry_t entry;
-  char operation;
-  uint32_t address = 0;
-  int ret = 0;
-
-  ret = fscanf(trace_fp, " %c %x\n", &operation, &address);
-  if (ret != EOF) {
-    if (operation == 'R') {
-      entry.address = address;
-      entry.accesstype = READ;
-    } else if (operation == 'W') {
-      entry.address = address;
-      entry.accesstype = WRITE;
-    } else {
-      entry.address = 0;
-      entry.accesstype = INVALID;
-    }
-  } else {
-    entry.address = 0;
-    entry.accesstype = INVALID;
+// Without the TLB model, virtual and physical addresses are identical.
+uint64_t translate_address(memory_access_entry_t entry) {
+  if (tlb_enabled) {
+    return tlb_translate(entry.address);
   }
-
-  return entry;
-}
-
-uint32_t translate_address(memory_access_entry_t entry) {
-  return (entry.address & 0x000FFFFF);
+  return entry.address;
 }
@@ -0,0 +1,50 @@
+#ifndef COMMON_H_
+#define COMMON_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum { READ, WRITE, INVALID } access_t;
+
+typedef enum { HIT, MISS, ERROR } op_result_t;
+
+// One access from the trace. Addresses are 64 bits wide end to end. pc is
+// the address of the instruction that issued the access, or 0 when the
+// trace does not carry one.
+typedef struct {
+  uint64_t address;
+  uint64_t pc;
+  access_t accesstype;
+} memory_access_entry_t;
+
+// Input parameters.
+extern char *usage_str;
+extern uint32_t verbose;
+extern char *trace_file;
+
+uint64_t translate_address(memory_access_entry_t entry);
+
+static inline int is_power_of_two(uint64_t x) {
+  return x != 0 && (x & (x - 1)) == 0;
+}
+
+static inline uint32_t log2_u64(uint64_t x) {
+  uint32_t r = 0;
+  while (x > 1) { x >>= 1; r++; }
+  return r;
+}
+
+// Finalizer of splitmix64; also used on its own as a cheap 64-bit hash.
+static inline uint64_t mix64(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// splitmix64: small, fast and identical on every platform.
+static inline uint64_t splitmix64(uint64_t *state) {
+  return mix64(*state += 0x9E3779B97F4A7C15ULL);
+}
+
+#endif /* COMMON_H_ */
@@ -0,0 +1,393 @@
+#include "dram.h"
+#include "cache.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Every request moves whole bursts; the address bits below a burst never
+// reach the DRAM.
+#define DRAM_BURST_BYTES 64
+#define MAX_DRAM_QUEUE_DEPTH 1024
+
+typedef enum {
+    FIELD_ROW,
+    FIELD_RANK,
+    FIELD_BANK,
+    FIELD_COLUMN,
+    FIELD_CHANNEL,
+    NUM_FIELDS
+} dram_field_t;
+
+static const char *field_names[NUM_FIELDS] = { "ro", "ra", "ba", "co", "ch" };
+
+typedef struct {
+    uint64_t arrival;
+    uint64_t row;
+    uint32_t bank;
+    uint32_t bytes;
+    bool write;
+} dram_request_t;
+
+// ready is the first cycle the bank accepts its next command.
+typedef struct {
+    bool row_open;
+    uint64_t open_row;
+    uint64_t ready;
+    uint64_t activated;
+    uint64_t write_done;
+} dram_bank_t;
+
+// Each channel has its own request queue, kept in arrival order, and its own
+// data bus. sched_time is the cycle of the next scheduling decision.
+typedef struct {
+    dram_request_t *queue;
+    uint32_t count;
+    uint64_t sched_time;
+    uint64_t bus_free;
+    dram_bank_t *banks;
+} dram_channel_t;
+
+bool dram_enabled = false;
+uint32_t dram_channels = 1;
+uint32_t dram_ranks = 1;
+uint32_t dram_banks = 16;
+uint32_t dram_row_size = 8192;
+uint32_t dram_rows = 65536;
+uint32_t dram_queue_depth = 32;
+dram_page_policy_t dram_page_policy = DRAM_PAGE_OPEN;
+// DDR4-3200 behind a 3.2 GHz core: two core cycles per memory clock.
+uint32_t dram_tCL = 44;
+uint32_t dram_tRCD = 44;
+uint32_t dram_tRP = 44;
+uint32_t dram_tRAS = 104;
+uint32_t dram_tWR = 48;
+uint32_t dram_tBURST = 8;
+
+uint64_t dram_reads = 0;
+uint64_t dram_writes = 0;
+uint64_t dram_row_hits = 0;
+uint64_t dram_row_misses = 0;
+uint64_t dram_bank_conflicts = 0;
+uint64_t dram_queue_full_stalls = 0;
+uint64_t dram_stall_cycles = 0;
+uint64_t dram_queue_cycles = 0;
+uint64_t dram_read_latency_cycles = 0;
+uint64_t dram_bytes = 0;
+
+// Address fields from the most to the least significant bits.
+static dram_field_t address_map[NUM_FIELDS] = {
+    FIELD_ROW, FIELD_RANK, FIELD_BANK, FIELD_COLUMN, FIELD_CHANNEL
+};
+static uint32_t field_bits[NUM_FIELDS];
+static dram_channel_t *channels = NULL;
+static bool dram_started = false;
+static uint64_t first_arrival = 0;
+static uint64_t last_completion = 0;
+
+static uint64_t max_u64(uint64_t a, uint64_t b) {
+    return a > b ? a : b;
+}
+
+// Requests arrive on the core clock of the fixed-latency model. The core
+// keeps issuing while misses are outstanding and only stalls when a request
+// finds its channel queue full; those stalls push back every later arrival.
+static uint64_t core_cycles(void) {
+    return L1_cache_total_accesses * CYCLES_L1_ACCESS
+        + L2_cache_total_accesses * CYCLES_L2_ACCESS
+        + dram_stall_cycles;
+}
+
+void initialize_dram(void) {
+    if (!dram_enabled) return;
+
+    field_bits[FIELD_ROW] = log2_u64(dram_rows);
+    field_bits[FIELD_RANK] = log2_u64(dram_ranks);
+    field_bits[FIELD_BANK] = log2_u64(dram_banks);
+    field_bits[FIELD_COLUMN] = log2_u64(dram_row_size / DRAM_BURST_BYTES);
+    field_bits[FIELD_CHANNEL] = log2_u64(dram_channels);
+
+    channels = calloc(dram_channels, sizeof(dram_channel_t));
+    for (uint32_t i = 0; i < dram_channels; i++) {
+        channels[i].queue = calloc(dram_queue_depth, sizeof(dram_request_t));
+        channels[i].banks = calloc((size_t)dram_ranks * dram_banks, sizeof(dram_bank_t));
+    }
+    dram_started = false;
+    first_arrival = 0;
+    last_completion = 0;
+}
+
+static void map_address(uint64_t pa, uint32_t *channel, uint32_t *bank, uint64_t *row) {
+    uint64_t x = pa / DRAM_BURST_BYTES;
+    uint64_t field[NUM_FIELDS];
+    for (int i = NUM_FIELDS - 1; i >= 0; i--) {
+        dram_field_t f = address_map[i];
+        field[f] = x & ((1ULL << field_bits[f]) - 1);
+        x >>= field_bits[f];
+    }
+    // Bits above the mapped fields extend the row so that distinct bursts
+    // never alias.
+    *row = field[FIELD_ROW] | (x << field_bits[FIELD_ROW]);
+    *channel = (uint32_t)field[FIELD_CHANNEL];
+    *bank = (uint32_t)(field[FIELD_RANK] * dram_banks + field[FIELD_BANK]);
+}
+
+// Issue request i of ch at cycle now: open its row if needed, move its data
+// over the channel bus and update the bank and statistics.
+static void issue_request(dram_channel_t *ch, uint32_t i, uint64_t now) {
+    dram_request_t r = ch->queue[i];
+    memmove(&ch->queue[i], &ch->queue[i + 1], (ch->count - i - 1) * sizeof(dram_request_t));
+    ch->count--;
+
+    dram_bank_t *b = &ch->banks[r.bank];
+    uint64_t column;
+    if (b->row_open && b->open_row == r.row) {
+        dram_row_hits++;
+        column = now;
+    } else {
+        uint64_t activate = now;
+        if (b->row_open) {
+            dram_bank_conflicts++;
+            uint64_t precharge = max_u64(now, max_u64(b->activated + dram_tRAS, b->write_done + dram_tWR));
+            activate = precharge + dram_tRP;
+        } else {
+            dram_row_misses++;
+        }
+        b->row_open = true;
+        b->open_row = r.row;
+        b->activated = activate;
+        column = activate + dram_tRCD;
+    }
+
+    uint64_t bursts = (r.bytes + DRAM_BURST_BYTES - 1) / DRAM_BURST_BYTES;
+    if (bursts == 0) bursts = 1;
+    uint64_t data = max_u64(column + dram_tCL, ch->bus_free);
+    uint64_t done = data + bursts * dram_tBURST;
+    ch->bus_free = done;
+    b->ready = done - dram_tCL;
+    if (r.write) b->write_done = done;
+
+    if (dram_page_policy == DRAM_PAGE_CLOSED) {
+        uint64_t precharge = max_u64(b->ready, max_u64(b->activated + dram_tRAS, b->write_done + dram_tWR));
+        b->ready = precharge + dram_tRP;
+        b->row_open = false;
+    }
+
+    if (r.write) {
+        dram_writes++;
+    } else {
+        dram_reads++;
+        dram_read_latency_cycles += done - r.arrival;
+    }
+    dram_queue_cycles += now - r.arrival;
+    dram_bytes += r.bytes;
+    last_completion = max_u64(last_completion, done);
+}
+
+// Make the next scheduling decision of ch if it falls before cycle until, or
+// regardless of until when force is set. FR-FCFS: among the requests that
+// have arrived and whose bank is ready, the oldest row hit goes first, then
+// the oldest request. Returns false when no decision was made.
+static bool schedule_next(dram_channel_t *ch, uint64_t until, bool force) {
+    if (ch->count == 0) return false;
+
+    uint64_t now = UINT64_MAX;
+    for (uint32_t i = 0; i < ch->count; i++) {
+        const dram_request_t *r = &ch->queue[i];
+        uint64_t t = max_u64(r->arrival, ch->banks[r->bank].ready);
+        if (t < now) now = t;
+    }
+    now = max_u64(now, ch->sched_time);
+    if (!force && now >= until) return false;
+
+    int pick = -1;
+    for (uint32_t i = 0; i < ch->count; i++) {
+        const dram_request_t *r = &ch->queue[i];
+        const dram_bank_t *b = &ch->banks[r->bank];
+        if (r->arrival > now || b->ready > now) continue;
+        if (b->row_open && b->open_row == r->row) {
+            pick = i;
+            break;
+        }
+        if (pick < 0) pick = i;
+    }
+
+    issue_request(ch, (uint32_t)pick, now);
+    ch->sched_time = now + 1;
+    return true;
+}
+
+// Queue one memory request. Decisions the channel would have made before
+// the request arrived are taken first so that it only competes with the
+// requests still waiting at that point.
+void dram_access(uint64_t pa, uint64_t bytes, bool write) {
+    if (!dram_enabled) return;
+
+    uint64_t now = core_cycles();
+    uint32_t c, bank;
+    uint64_t row;
+    map_address(pa, &c, &bank, &row);
+    dram_channel_t *ch = &channels[c];
+
+    while (schedule_next(ch, now, false)) {}
+    if (ch->count == dram_queue_depth) {
+        dram_queue_full_stalls++;
+        schedule_next(ch, now, true);
+        uint64_t freed = ch->sched_time - 1;
+        if (freed > now) {
+            dram_stall_cycles += freed - now;
+            now = freed;
+        }
+    }
+
+    if (!dram_started) {
+        dram_started = true;
+        first_arrival = now;
+    }
+    dram_request_t *r = &ch->queue[ch->count++];
+    r->arrival = now;
+    r->row = row;
+    r->bank = bank;
+    r->bytes = (uint32_t)bytes;
+    r->write = write;
+}
+
+// Complete the requests still queued, then release the model.
+void free_dram(void) {
+    if (!dram_enabled || channels == NULL) return;
+    for (uint32_t i = 0; i < dram_channels; i++) {
+        while (schedule_next(&channels[i], 0, true)) {}
+        free(channels[i].queue);
+        free(channels[i].banks);
+    }
+    free(channels);
+    channels = NULL;
+}
+
+void reset_dram_statistics(void) {
+    dram_reads = dram_writes = 0;
+    dram_row_hits = dram_row_misses = dram_bank_conflicts = 0;
+    dram_queue_full_stalls = dram_stall_cycles = 0;
+    dram_queue_cycles = dram_read_latency_cycles = 0;
+    dram_bytes = 0;
+}
+
+void print_dram_statistics(void) {
+    if (!dram_enabled) return;
+    uint64_t issued = dram_reads + dram_writes;
+    uint64_t elapsed = last_completion - first_arrival;
+    uint64_t pending = 0;
+    for (uint32_t i = 0; channels != NULL && i < dram_channels; i++) pending += channels[i].count;
+
+    printf("\n* DRAM Statistics *\n");
+    printf("DRAM reads: %" PRIu64 "\n", dram_reads);
+    printf("DRAM writes: %" PRIu64 "\n", dram_writes);
+    printf("DRAM row buffer hits: %" PRIu64 "\n", dram_row_hits);
+    printf("DRAM row buffer misses: %" PRIu64 "\n", dram_row_misses);
+    printf("DRAM bank conflicts: %" PRIu64 "\n", dram_bank_conflicts);
+    printf("DRAM row buffer hit rate: %.4f\n", issued ? (double)dram_row_hits / issued : 0.0);
+    printf("DRAM average queueing latency: %.2f\n", issued ? (double)dram_queue_cycles / issued : 0.0);
+    printf("DRAM average read latency: %.2f\n", dram_reads ? (double)dram_read_latency_cycles / dram_reads : 0.0);
+    printf("DRAM queue full stalls: %" PRIu64 "\n", dram_queue_full_stalls);
+    printf("DRAM queue full stall cycles: %" PRIu64 "\n", dram_stall_cycles);
+    printf("DRAM bandwidth (bytes/cycle): %.4f\n", elapsed ? (double)dram_bytes / elapsed : 0.0);
+    if (pending != 0) printf("DRAM pending requests: %" PRIu64 "\n", pending);
+}
+
+static int parse_u32(const char *val, uint32_t *out) {
+    char *end = NULL;
+    unsigned long n = strtoul(val, &end, 10);
+    if (end == val || *end != '\0' || n > UINT32_MAX) return 1;
+    *out = (uint32_t)n;
+    return 0;
+}
+
+static int parse_power_of_two(const char *val, uint32_t *out) {
+    uint32_t n;
+    if (parse_u32(val, &n) || !is_power_of_two(n)) return 1;
+    *out = n;
+    return 0;
+}
+
+// The map lists all five fields, most significant first, separated by ':'.
+static int parse_address_map(const char *val) {
+    dram_field_t map[NUM_FIELDS];
+    uint32_t seen = 0;
+    int n = 0;
+    for (const char *p = val; *p != '\0'; p += 2) {
+        if (n == NUM_FIELDS) return 1;
+        if (n > 0) {
+            if (*p != ':') return 1;
+            p++;
+        }
+        int f = 0;
+        while (f < NUM_FIELDS && strncmp(p, field_names[f], 2) != 0) f++;
+        if (f == NUM_FIELDS || (seen & (1u << f))) return 1;
+        seen |= 1u << f;
+        map[n++] = (dram_field_t)f;
+    }
+    if (n != NUM_FIELDS) return 1;
+    memcpy(address_map, map, sizeof(map));
+    return 0;
+}
+
+// -X takes a comma-separated list of key=value settings, any of which may be
+// omitted:
+//   channels=<n>  ranks=<n>  banks=<n>  row=<bytes>  rows=<n>  queue=<n>
+//   page=open|closed  map=<fields>  tCL=  tRCD=  tRP=  tRAS=  tWR=  tBURST=
+// where map orders ro, ra, ba, co and ch from the most significant bit, e.g.
+// the default ro:ra:ba:co:ch. "-X on" enables the model with the defaults.
+int process_arg_X(int opt, char *optarg) {
+    char buf[256];
+    char *save = NULL;
+
+    dram_enabled = true;
+    if (strcmp(optarg, "on") == 0) return 0;
+    if (strlen(optarg) >= sizeof(buf)) return 1;
+    strcpy(buf, optarg);
+
+    for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (val == NULL) return 1;
+        *val++ = '\0';
+
+        if (strcmp(tok, "channels") == 0) {
+            if (parse_power_of_two(val, &dram_channels)) return 1;
+        } else if (strcmp(tok, "ranks") == 0) {
+            if (parse_power_of_two(val, &dram_ranks)) return 1;
+        } else if (strcmp(tok, "banks") == 0) {
+            if (parse_power_of_two(val, &dram_banks)) return 1;
+        } else if (strcmp(tok, "row") == 0) {
+            if (parse_power_of_two(val, &dram_row_size) || dram_row_size < DRAM_BURST_BYTES) return 1;
+        } else if (strcmp(tok, "rows") == 0) {
+            if (parse_power_of_two(val, &dram_rows)) return 1;
+        } else if (strcmp(tok, "queue") == 0) {
+            if (parse_u32(val, &dram_queue_depth) || dram_queue_depth == 0 || dram_queue_depth > MAX_DRAM_QUEUE_DEPTH) return 1;
+        } else if (strcmp(tok, "page") == 0) {
+            if (strcmp(val, "open") == 0) {
+                dram_page_policy = DRAM_PAGE_OPEN;
+            } else if (strcmp(val, "closed") == 0) {
+                dram_page_policy = DRAM_PAGE_CLOSED;
+            } else {
+                return 1;
+            }
+        } else if (strcmp(tok, "map") == 0) {
+            if (parse_address_map(val)) return 1;
+        } else if (strcmp(tok, "tCL") == 0) {
+            if (parse_u32(val, &dram_tCL)) return 1;
+        } else if (strcmp(tok, "tRCD") == 0) {
+            if (parse_u32(val, &dram_tRCD)) return 1;
+        } else if (strcmp(tok, "tRP") == 0) {
+            if (parse_u32(val, &dram_tRP)) return 1;
+        } else if (strcmp(tok, "tRAS") == 0) {
+            if (parse_u32(val, &dram_tRAS)) return 1;
+        } else if (strcmp(tok, "tWR") == 0) {
+            if (parse_u32(val, &dram_tWR)) return 1;
+        } else if (strcmp(tok, "tBURST") == 0) {
+            if (parse_u32(val, &dram_tBURST) || dram_tBURST == 0) return 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
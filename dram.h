@@ -0,0 +1,50 @@
+#ifndef DRAM_H_
+#define DRAM_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+typedef enum {
+    DRAM_PAGE_OPEN,
+    DRAM_PAGE_CLOSED
+} dram_page_policy_t;
+
+// Input parameters to control the DRAM model. Memory is a fixed-cost sink
+// unless -X is given. Timings are in core cycles.
+extern bool dram_enabled;
+extern uint32_t dram_channels;
+extern uint32_t dram_ranks;
+extern uint32_t dram_banks;
+extern uint32_t dram_row_size;
+extern uint32_t dram_rows;
+extern uint32_t dram_queue_depth;
+extern dram_page_policy_t dram_page_policy;
+extern uint32_t dram_tCL;
+extern uint32_t dram_tRCD;
+extern uint32_t dram_tRP;
+extern uint32_t dram_tRAS;
+extern uint32_t dram_tWR;
+extern uint32_t dram_tBURST;
+
+// DRAM statistics counters. Requests are counted when the scheduler issues
+// them, so requests still queued are not included yet.
+extern uint64_t dram_reads;
+extern uint64_t dram_writes;
+extern uint64_t dram_row_hits;
+extern uint64_t dram_row_misses;
+extern uint64_t dram_bank_conflicts;
+extern uint64_t dram_queue_full_stalls;
+extern uint64_t dram_stall_cycles;
+extern uint64_t dram_queue_cycles;
+extern uint64_t dram_read_latency_cycles;
+extern uint64_t dram_bytes;
+
+void initialize_dram(void);
+void free_dram(void);
+void reset_dram_statistics(void);
+void print_dram_statistics(void);
+int process_arg_X(int opt, char *optarg);
+
+void dram_access(uint64_t pa, uint64_t bytes, bool write);
+
+#endif /* DRAM_H_ */
@@ -0,0 +1,100 @@
+/*
+ * Decoder for the binary event log written by sim -E.
+ *
+ * Build separately from the simulator:
+ *   cc -O2 -o evdecode evdecode.c
+ *
+ * Usage:
+ *   ./evdecode [-c] <event_log>
+ *
+ * Prints one event per line as text, or as CSV with -c.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "eventlog.h"
+
+static const char *event_kind_names[] = {
+    "hit", "miss", "evict", "writeback", "prefetch_fill", "back_invalidate"
+};
+
+#define NUM_EVENT_KINDS (sizeof(event_kind_names) / sizeof(event_kind_names[0]))
+
+static const char *level_name(uint8_t level) {
+    return level == 1 ? "L1" : level == 2 ? "L2" : "MEM";
+}
+
+int main(int argc, char *argv[]) {
+    int csv = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c")) != -1) {
+        switch (opt) {
+        case 'c':
+            csv = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: ./evdecode [-c] <event_log>\n");
+            return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: ./evdecode [-c] <event_log>\n");
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Cannot open %s.\n", argv[optind]);
+        return 1;
+    }
+
+    event_log_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+        || memcmp(hdr.magic, EVENT_LOG_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != EVENT_LOG_VERSION
+        || hdr.event_size != sizeof(cache_event_t)) {
+        fprintf(stderr, "%s is not a version %d event log.\n", argv[optind], EVENT_LOG_VERSION);
+        fclose(fp);
+        return 1;
+    }
+
+    if (csv) {
+        printf("seq,thread,level,event,write,dirty,address,victim,count\n");
+    }
+
+    static cache_event_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, sizeof(cache_event_t), 4096, fp)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            const cache_event_t *e = &buf[i];
+            const char *kind = e->kind < NUM_EVENT_KINDS ? event_kind_names[e->kind] : "unknown";
+            int write = (e->flags & EVENT_FLAG_WRITE) != 0;
+            int dirty = (e->flags & EVENT_FLAG_DIRTY) != 0;
+
+            if (csv) {
+                printf("%" PRIu64 ",%u,%s,%s,%d,%d,0x%" PRIx64 ",0x%" PRIx64 ",%u\n",
+                       e->seq, e->thread, level_name(e->level), kind,
+                       write, dirty, e->address, e->victim, e->count);
+            } else {
+                printf("#%" PRIu64 " t%u %s %s%s 0x%" PRIx64,
+                       e->seq, e->thread, level_name(e->level), kind,
+                       write ? " (write)" : "", e->address);
+                if (e->kind == EVENT_EVICT || e->kind == EVENT_WRITEBACK) {
+                    printf(" victim 0x%" PRIx64 "%s", e->victim, dirty ? " dirty" : "");
+                } else if (e->kind == EVENT_BACK_INVALIDATE && dirty) {
+                    printf(" dirty");
+                }
+                if (e->count != 1) printf(" x%u", e->count);
+                printf("\n");
+            }
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
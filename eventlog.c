@@ -0,0 +1,219 @@
+#include "eventlog.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Every producing thread owns a ring of chunks. It fills the head chunk
+// without locking and only takes the lock to hand a full chunk to the
+// flusher thread, which writes chunks to the file in the background.
+#define EVENT_CHUNK_EVENTS 65536
+#define EVENT_RING_CHUNKS 8
+
+typedef struct event_ring {
+    cache_event_t *chunks[EVENT_RING_CHUNKS];
+    uint32_t fill[EVENT_RING_CHUNKS];
+    bool full[EVENT_RING_CHUNKS];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t pos;
+    uint8_t thread;
+    struct event_ring *next;
+} event_ring_t;
+
+char *event_log_file = NULL;
+uint64_t event_log_sample_rate = 1;
+uint64_t event_log_range_lo = 0;
+uint64_t event_log_range_hi = UINT64_MAX;
+
+__thread bool event_log_active = false;
+
+static FILE *event_fp = NULL;
+static pthread_t flusher;
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t event_space = PTHREAD_COND_INITIALIZER;
+static event_ring_t *rings = NULL;
+static uint8_t num_rings = 0;
+static bool stopping = false;
+
+static __thread event_ring_t *my_ring = NULL;
+static __thread uint64_t current_seq = 0;
+
+static event_ring_t *new_ring(void) {
+    event_ring_t *r = calloc(1, sizeof(event_ring_t));
+    if (r == NULL) return NULL;
+    for (int i = 0; i < EVENT_RING_CHUNKS; i++) {
+        r->chunks[i] = malloc(EVENT_CHUNK_EVENTS * sizeof(cache_event_t));
+        if (r->chunks[i] == NULL) {
+            for (int j = 0; j < i; j++) free(r->chunks[j]);
+            free(r);
+            return NULL;
+        }
+    }
+    pthread_mutex_lock(&event_lock);
+    r->thread = num_rings++;
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&event_lock);
+    return r;
+}
+
+// Hand the head chunk to the flusher and wait for the next one to be free.
+// Called with event_lock held.
+static void submit_chunk_locked(event_ring_t *r) {
+    r->fill[r->head] = r->pos;
+    r->full[r->head] = true;
+    r->head = (r->head + 1) % EVENT_RING_CHUNKS;
+    r->pos = 0;
+    pthread_cond_signal(&event_work);
+    while (r->full[r->head]) {
+        pthread_cond_wait(&event_space, &event_lock);
+    }
+}
+
+static void *flush_events(void *arg) {
+    pthread_mutex_lock(&event_lock);
+    while (1) {
+        event_ring_t *ready = NULL;
+        for (event_ring_t *r = rings; r != NULL; r = r->next) {
+            if (r->full[r->tail]) {
+                ready = r;
+                break;
+            }
+        }
+
+        if (ready == NULL) {
+            if (stopping) break;
+            pthread_cond_wait(&event_work, &event_lock);
+            continue;
+        }
+
+        uint32_t slot = ready->tail;
+        pthread_mutex_unlock(&event_lock);
+        fwrite(ready->chunks[slot], sizeof(cache_event_t), ready->fill[slot], event_fp);
+        pthread_mutex_lock(&event_lock);
+
+        ready->full[slot] = false;
+        ready->tail = (slot + 1) % EVENT_RING_CHUNKS;
+        pthread_cond_broadcast(&event_space);
+    }
+    pthread_mutex_unlock(&event_lock);
+    return NULL;
+}
+
+int event_log_open(void) {
+    if (event_log_file == NULL) return 0;
+
+    event_fp = fopen(event_log_file, "wb");
+    if (event_fp == NULL) return -1;
+
+    event_log_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EVENT_LOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = EVENT_LOG_VERSION;
+    hdr.event_size = sizeof(cache_event_t);
+    if (fwrite(&hdr, sizeof(hdr), 1, event_fp) != 1) {
+        fclose(event_fp);
+        event_fp = NULL;
+        return -1;
+    }
+
+    stopping = false;
+    if (pthread_create(&flusher, NULL, flush_events, NULL) != 0) {
+        fclose(event_fp);
+        event_fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Flush every partially filled chunk, stop the flusher and close the file.
+void event_log_close(void) {
+    if (event_fp == NULL) return;
+
+    pthread_mutex_lock(&event_lock);
+    for (event_ring_t *r = rings; r != NULL; r = r->next) {
+        if (r->pos != 0) submit_chunk_locked(r);
+    }
+    stopping = true;
+    pthread_cond_signal(&event_work);
+    pthread_mutex_unlock(&event_lock);
+    pthread_join(flusher, NULL);
+
+    while (rings != NULL) {
+        event_ring_t *r = rings;
+        rings = r->next;
+        for (int i = 0; i < EVENT_RING_CHUNKS; i++) free(r->chunks[i]);
+        free(r);
+    }
+    num_rings = 0;
+    my_ring = NULL;
+    event_log_active = false;
+
+    fclose(event_fp);
+    event_fp = NULL;
+}
+
+// Decide whether the access about to be simulated is recorded. address is
+// the trace address, before translation.
+void event_log_begin_access(uint64_t seq, uint64_t address) {
+    current_seq = seq;
+    event_log_active = event_fp != NULL
+        && seq % event_log_sample_rate == 0
+        && address >= event_log_range_lo && address < event_log_range_hi;
+}
+
+void event_log_record(uint8_t level, uint8_t kind, uint8_t flags, uint64_t address, uint64_t victim, uint32_t count) {
+    event_ring_t *r = my_ring;
+    if (r == NULL) {
+        r = my_ring = new_ring();
+        if (r == NULL) {
+            event_log_active = false;
+            return;
+        }
+    }
+
+    cache_event_t *e = &r->chunks[r->head][r->pos++];
+    e->seq = current_seq;
+    e->address = address;
+    e->victim = victim;
+    e->count = count;
+    e->thread = r->thread;
+    e->level = level;
+    e->kind = kind;
+    e->flags = flags;
+
+    if (r->pos == EVENT_CHUNK_EVENTS) {
+        pthread_mutex_lock(&event_lock);
+        submit_chunk_locked(r);
+        pthread_mutex_unlock(&event_lock);
+    }
+}
+
+// -E takes the output file optionally followed by comma-separated settings:
+//   sample=<N>            record every Nth access
+//   range=<lo>:<hi>       only accesses with lo <= address < hi (hex)
+int process_arg_E(int opt, char *optarg) {
+    char *save = NULL;
+    char *tok = strtok_r(optarg, ",", &save);
+    if (tok == NULL || *tok == '\0') return 1;
+    event_log_file = tok;
+
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+        char *end = NULL;
+        if (strncmp(tok, "sample=", 7) == 0) {
+            event_log_sample_rate = strtoull(tok + 7, &end, 10);
+            if (end == tok + 7 || *end != '\0' || event_log_sample_rate == 0) return 1;
+        } else if (strncmp(tok, "range=", 6) == 0) {
+            event_log_range_lo = strtoull(tok + 6, &end, 16);
+            if (end == tok + 6 || *end != ':') return 1;
+            char *hi = end + 1;
+            event_log_range_hi = strtoull(hi, &end, 16);
+            if (end == hi || *end != '\0' || event_log_range_hi <= event_log_range_lo) return 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
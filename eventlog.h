@@ -0,0 +1,64 @@
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+#define EVENT_LOG_MAGIC "CSIMEVT1"
+#define EVENT_LOG_VERSION 1
+
+typedef enum {
+    EVENT_HIT,
+    EVENT_MISS,
+    EVENT_EVICT,
+    EVENT_WRITEBACK,
+    EVENT_PREFETCH_FILL,
+    EVENT_BACK_INVALIDATE
+} cache_event_kind_t;
+
+#define EVENT_FLAG_WRITE 0x1
+#define EVENT_FLAG_DIRTY 0x2
+
+// One per-access outcome. address and victim are physical block addresses;
+// count is larger than one for hits credited in bulk to a coalesced run.
+typedef struct {
+    uint64_t seq;
+    uint64_t address;
+    uint64_t victim;
+    uint32_t count;
+    uint8_t thread;
+    uint8_t level;
+    uint8_t kind;
+    uint8_t flags;
+} cache_event_t;
+
+// File header; events follow back to back.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;
+} event_log_header_t;
+
+// Input parameters.
+extern char *event_log_file;
+extern uint64_t event_log_sample_rate;
+extern uint64_t event_log_range_lo;
+extern uint64_t event_log_range_hi;
+
+// True while the current access is being recorded. Checked inline on the hot
+// path so a disabled or sampled-out access costs one load and branch.
+extern __thread bool event_log_active;
+
+int process_arg_E(int opt, char *optarg);
+int event_log_open(void);
+void event_log_close(void);
+void event_log_begin_access(uint64_t seq, uint64_t address);
+void event_log_record(uint8_t level, uint8_t kind, uint8_t flags, uint64_t address, uint64_t victim, uint32_t count);
+
+#define CACHE_EVENT(level, kind, flags, address, victim, count)                  \
+    do {                                                                         \
+        if (event_log_active)                                                    \
+            event_log_record((level), (kind), (flags), (address), (victim), (count)); \
+    } while (0)
+
+#endif /* EVENTLOG_H_ */
@@ -0,0 +1,327 @@
+#include "interval.h"
+#include "cache.h"
+#include "tlb.h"
+#include "dram.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Working-set size is estimated with a HyperLogLog sketch so that memory use
+// stays constant however many distinct blocks an interval touches.
+#define HLL_BITS 12
+#define HLL_REGISTERS (1u << HLL_BITS)
+
+#define PHASE_EWMA_WEIGHT 0.25
+#define MAX_INTERVAL_COUNTERS 32
+
+typedef struct {
+    const char *name;
+    const uint64_t *value;
+} interval_counter_t;
+
+char *interval_file = NULL;
+uint64_t interval_length = 100000;
+interval_unit_t interval_unit = INTERVAL_UNIT_ACCESSES;
+interval_format_t interval_format = INTERVAL_FORMAT_CSV;
+uint32_t interval_heat_bins = 0;
+double interval_phase_threshold = 0;
+
+bool interval_heat_enabled = false;
+
+static FILE *interval_fp = NULL;
+static interval_counter_t counters[MAX_INTERVAL_COUNTERS];
+static uint64_t previous[MAX_INTERVAL_COUNTERS];
+static int num_counters = 0;
+static uint8_t hll[HLL_REGISTERS];
+static uint32_t block_bits = 0;
+static uint64_t *heat[2] = { NULL, NULL };
+static uint32_t heat_bins[2] = { 0, 0 };
+static uint32_t heat_shift[2] = { 0, 0 };
+static uint64_t interval_number = 0;
+static uint64_t interval_start = 0;
+static uint64_t next_boundary = 0;
+static uint64_t last_accesses = 0;
+static double miss_rate_ewma = -1;
+
+static void add_counter(const char *name, const uint64_t *value) {
+    if (num_counters == MAX_INTERVAL_COUNTERS) return;
+    counters[num_counters].name = name;
+    counters[num_counters].value = value;
+    num_counters++;
+}
+
+// With the DRAM model, memory reads cost their modelled latency and the
+// posted writes nothing; reads still queued are charged once issued.
+static uint64_t estimated_cycles(void) {
+    return L1_cache_total_accesses * CYCLES_L1_ACCESS
+        + L2_cache_total_accesses * CYCLES_L2_ACCESS
+        + (dram_enabled ? dram_read_latency_cycles : memory_total_accesses * CYCLES_MEMORY_ACCESS);
+}
+
+static uint64_t interval_position(uint64_t accesses) {
+    return interval_unit == INTERVAL_UNIT_CYCLES ? estimated_cycles() : accesses;
+}
+
+static double hll_estimate(void) {
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (uint32_t i = 0; i < HLL_REGISTERS; i++) {
+        sum += ldexp(1.0, -hll[i]);
+        if (hll[i] == 0) zeros++;
+    }
+    double m = HLL_REGISTERS;
+    double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros != 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+int interval_open(void) {
+    if (interval_file == NULL) return 0;
+
+    interval_fp = fopen(interval_file, "w");
+    if (interval_fp == NULL) return -1;
+
+    num_counters = 0;
+    add_counter("L1_total_accesses", &L1_cache_total_accesses);
+    add_counter("L1_hits", &L1_cache_hits);
+    add_counter("L1_misses", &L1_cache_misses);
+    add_counter("L1_reads", &L1_cache_read_accesses);
+    add_counter("L1_read_hits", &L1_cache_read_hits);
+    add_counter("L1_writes", &L1_cache_write_accesses);
+    add_counter("L1_write_hits", &L1_cache_write_hits);
+    if (cache_level == 2) {
+        add_counter("L2_total_accesses", &L2_cache_total_accesses);
+        add_counter("L2_hits", &L2_cache_hits);
+        add_counter("L2_misses", &L2_cache_misses);
+        add_counter("L2_reads", &L2_cache_read_accesses);
+        add_counter("L2_read_hits", &L2_cache_read_hits);
+        add_counter("L2_writes", &L2_cache_write_accesses);
+        add_counter("L2_write_hits", &L2_cache_write_hits);
+    }
+    add_counter("memory_total_accesses", &memory_total_accesses);
+    add_counter("memory_reads", &memory_read_accesses);
+    add_counter("memory_writes", &memory_write_accesses);
+    add_counter("memory_read_bytes", &memory_read_bytes);
+    add_counter("memory_write_bytes", &memory_write_bytes);
+    if (tlb_enabled) {
+        add_counter("DTLB_hits", &dtlb_hits);
+        add_counter("DTLB_misses", &dtlb_misses);
+        add_counter("STLB_hits", &stlb_hits);
+        add_counter("STLB_misses", &stlb_misses);
+        add_counter("page_walks", &page_walks);
+        add_counter("page_walk_memory_accesses", &page_walk_memory_accesses);
+    }
+    if (dram_enabled) {
+        add_counter("DRAM_row_hits", &dram_row_hits);
+        add_counter("DRAM_bank_conflicts", &dram_bank_conflicts);
+        add_counter("DRAM_read_latency_cycles", &dram_read_latency_cycles);
+    }
+    for (int i = 0; i < num_counters; i++) previous[i] = *counters[i].value;
+
+    memset(hll, 0, sizeof(hll));
+    block_bits = log2_u64(L1_cache_block_size);
+
+    // Sets are folded into at most interval_heat_bins equal ranges per level.
+    interval_heat_enabled = interval_heat_bins != 0;
+    for (uint32_t level = 0; interval_heat_enabled && level < cache_level; level++) {
+        uint64_t num_sets = get_cache_num_sets(level + 1);
+        heat_bins[level] = num_sets < interval_heat_bins ? (uint32_t)num_sets : interval_heat_bins;
+        heat_shift[level] = log2_u64(num_sets) - log2_u64(heat_bins[level]);
+        heat[level] = calloc(heat_bins[level], sizeof(uint64_t));
+        if (heat[level] == NULL) return -1;
+    }
+
+    interval_number = 0;
+    interval_start = interval_position(0);
+    next_boundary = interval_start + interval_length;
+    last_accesses = 0;
+    miss_rate_ewma = -1;
+
+    if (interval_format == INTERVAL_FORMAT_CSV) {
+        fprintf(interval_fp, "interval,start,end");
+        for (int i = 0; i < num_counters; i++) fprintf(interval_fp, ",%s", counters[i].name);
+        fprintf(interval_fp, ",working_set_blocks");
+        if (interval_phase_threshold > 0) fprintf(interval_fp, ",phase_change");
+        for (uint32_t level = 0; interval_heat_enabled && level < cache_level; level++) {
+            for (uint32_t b = 0; b < heat_bins[level]; b++) fprintf(interval_fp, ",L%u_heat_%u", level + 1, b);
+        }
+        fprintf(interval_fp, "\n");
+    }
+    return 0;
+}
+
+static void print_heat_jsonl(uint32_t level) {
+    fprintf(interval_fp, ", \"L%u_miss_heat\": [", level + 1);
+    for (uint32_t b = 0; b < heat_bins[level]; b++) {
+        fprintf(interval_fp, "%s%" PRIu64, b ? ", " : "", heat[level][b]);
+    }
+    fprintf(interval_fp, "]");
+}
+
+// Write the interval that ends at position end and start the next one.
+static void emit_interval(uint64_t end) {
+    uint64_t delta[MAX_INTERVAL_COUNTERS];
+    for (int i = 0; i < num_counters; i++) {
+        delta[i] = *counters[i].value - previous[i];
+        previous[i] = *counters[i].value;
+    }
+
+    // Counters 0 and 2 are the L1 accesses and misses.
+    int phase_change = 0;
+    if (interval_phase_threshold > 0 && delta[0] != 0) {
+        double miss_rate = (double)delta[2] / delta[0];
+        if (miss_rate_ewma >= 0 && fabs(miss_rate - miss_rate_ewma) > interval_phase_threshold) {
+            phase_change = 1;
+        }
+        miss_rate_ewma = miss_rate_ewma < 0
+            ? miss_rate
+            : PHASE_EWMA_WEIGHT * miss_rate + (1 - PHASE_EWMA_WEIGHT) * miss_rate_ewma;
+    }
+
+    uint64_t working_set = (uint64_t)(hll_estimate() + 0.5);
+
+    if (interval_format == INTERVAL_FORMAT_CSV) {
+        fprintf(interval_fp, "%" PRIu64 ",%" PRIu64 ",%" PRIu64, interval_number, interval_start, end);
+        for (int i = 0; i < num_counters; i++) fprintf(interval_fp, ",%" PRIu64, delta[i]);
+        fprintf(interval_fp, ",%" PRIu64, working_set);
+        if (interval_phase_threshold > 0) fprintf(interval_fp, ",%d", phase_change);
+        for (uint32_t level = 0; interval_heat_enabled && level < cache_level; level++) {
+            for (uint32_t b = 0; b < heat_bins[level]; b++) fprintf(interval_fp, ",%" PRIu64, heat[level][b]);
+        }
+        fprintf(interval_fp, "\n");
+    } else {
+        fprintf(interval_fp, "{\"interval\": %" PRIu64 ", \"start\": %" PRIu64 ", \"end\": %" PRIu64 ", \"deltas\": {",
+                interval_number, interval_start, end);
+        for (int i = 0; i < num_counters; i++) {
+            fprintf(interval_fp, "%s\"%s\": %" PRIu64, i ? ", " : "", counters[i].name, delta[i]);
+        }
+        fprintf(interval_fp, "}, \"working_set_blocks\": %" PRIu64, working_set);
+        if (interval_phase_threshold > 0) fprintf(interval_fp, ", \"phase_change\": %s", phase_change ? "true" : "false");
+        for (uint32_t level = 0; interval_heat_enabled && level < cache_level; level++) print_heat_jsonl(level);
+        fprintf(interval_fp, "}\n");
+    }
+
+    memset(hll, 0, sizeof(hll));
+    for (uint32_t level = 0; interval_heat_enabled && level < cache_level; level++) {
+        memset(heat[level], 0, heat_bins[level] * sizeof(uint64_t));
+    }
+    interval_number++;
+    interval_start = end;
+}
+
+// Emit the final, possibly partial, interval and close the file.
+void interval_close(void) {
+    if (interval_fp == NULL) return;
+
+    uint64_t end = interval_position(last_accesses);
+    if (end != interval_start) emit_interval(end);
+
+    for (int level = 0; level < 2; level++) {
+        free(heat[level]);
+        heat[level] = NULL;
+    }
+    interval_heat_enabled = false;
+    fclose(interval_fp);
+    interval_fp = NULL;
+}
+
+// Emit the partial interval and count from zero again; called just before
+// the simulator resets all of its statistics.
+void interval_restart(void) {
+    if (interval_fp == NULL) return;
+
+    uint64_t end = interval_position(last_accesses);
+    if (end != interval_start) emit_interval(end);
+
+    memset(previous, 0, sizeof(previous));
+    interval_start = 0;
+    next_boundary = interval_length;
+    last_accesses = 0;
+    miss_rate_ewma = -1;
+}
+
+void interval_record_access(uint64_t pa) {
+    if (interval_fp == NULL) return;
+    uint64_t h = mix64(pa >> block_bits);
+    uint32_t reg = (uint32_t)(h >> (64 - HLL_BITS));
+    uint64_t rest = h << HLL_BITS;
+    uint8_t rank = rest == 0 ? 64 - HLL_BITS + 1 : (uint8_t)(__builtin_clzll(rest) + 1);
+    if (rank > hll[reg]) hll[reg] = rank;
+}
+
+void interval_record_miss(uint32_t level, uint64_t index) {
+    heat[level - 1][index >> heat_shift[level - 1]]++;
+}
+
+// Called after every simulated record with the running access count.
+void interval_tick(uint64_t accesses) {
+    if (interval_fp == NULL) return;
+    last_accesses = accesses;
+    uint64_t pos = interval_position(accesses);
+    if (pos < next_boundary) return;
+    emit_interval(pos);
+    next_boundary = (pos / interval_length + 1) * interval_length;
+}
+
+// First access count after accesses at which an access-based interval ends,
+// or UINT64_MAX when intervals are not counted in accesses. Coalesced records
+// are split there so that deltas match unfiltered runs.
+uint64_t interval_next_end(uint64_t accesses) {
+    if (interval_fp == NULL || interval_unit != INTERVAL_UNIT_ACCESSES) return UINT64_MAX;
+    return (accesses / interval_length + 1) * interval_length;
+}
+
+// -I takes the output file optionally followed by comma-separated settings:
+//   every=<N>                interval length (default 100000)
+//   unit=accesses|cycles     cycles are estimated from fixed level latencies
+//   format=csv|jsonl
+//   heat=<bins>              per-level set-miss heat maps, power of two
+//   phase=<threshold>        flag L1 miss-rate jumps larger than threshold
+int process_arg_I(int opt, char *optarg) {
+    char *save = NULL;
+    char *tok = strtok_r(optarg, ",", &save);
+    if (tok == NULL || *tok == '\0') return 1;
+    interval_file = tok;
+
+    while ((tok = strtok_r(NULL, ",", &save)) != NULL) {
+        char *val = strchr(tok, '=');
+        char *end = NULL;
+        if (val == NULL) return 1;
+        *val++ = '\0';
+
+        if (strcmp(tok, "every") == 0) {
+            interval_length = strtoull(val, &end, 10);
+            if (end == val || *end != '\0' || interval_length == 0) return 1;
+        } else if (strcmp(tok, "unit") == 0) {
+            if (strcmp(val, "accesses") == 0) {
+                interval_unit = INTERVAL_UNIT_ACCESSES;
+            } else if (strcmp(val, "cycles") == 0) {
+                interval_unit = INTERVAL_UNIT_CYCLES;
+            } else {
+                return 1;
+            }
+        } else if (strcmp(tok, "format") == 0) {
+            if (strcmp(val, "csv") == 0) {
+                interval_format = INTERVAL_FORMAT_CSV;
+            } else if (strcmp(val, "jsonl") == 0) {
+                interval_format = INTERVAL_FORMAT_JSONL;
+            } else {
+                return 1;
+            }
+        } else if (strcmp(tok, "heat") == 0) {
+            unsigned long bins = strtoul(val, &end, 10);
+            if (end == val || *end != '\0' || !is_power_of_two(bins) || bins > 65536) return 1;
+            interval_heat_bins = (uint32_t)bins;
+        } else if (strcmp(tok, "phase") == 0) {
+            interval_phase_threshold = strtod(val, &end);
+            if (end == val || *end != '\0' || interval_phase_threshold <= 0) return 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
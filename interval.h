@@ -0,0 +1,42 @@
+#ifndef INTERVAL_H_
+#define INTERVAL_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+typedef enum {
+    INTERVAL_UNIT_ACCESSES,
+    INTERVAL_UNIT_CYCLES
+} interval_unit_t;
+
+typedef enum {
+    INTERVAL_FORMAT_CSV,
+    INTERVAL_FORMAT_JSONL
+} interval_format_t;
+
+// Input parameters.
+extern char *interval_file;
+extern uint64_t interval_length;
+extern interval_unit_t interval_unit;
+extern interval_format_t interval_format;
+extern uint32_t interval_heat_bins;
+extern double interval_phase_threshold;
+
+// True when per-set misses are being binned into heat maps.
+extern bool interval_heat_enabled;
+
+int process_arg_I(int opt, char *optarg);
+int interval_open(void);
+void interval_close(void);
+void interval_restart(void);
+void interval_record_access(uint64_t pa);
+void interval_record_miss(uint32_t level, uint64_t index);
+void interval_tick(uint64_t accesses);
+uint64_t interval_next_end(uint64_t accesses);
+
+#define INTERVAL_MISS(level, index)                                               \
+    do {                                                                          \
+        if (interval_heat_enabled) interval_record_miss((level), (index));        \
+    } while (0)
+
+#endif /* INTERVAL_H_ */
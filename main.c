@@ -10,16 +10,55 @@
 #include <unistd.h>
 
 #include "cache.h"
+#include "dram.h"
+#include "eventlog.h"
+#include "interval.h"
+#include "pcstats.h"
+#include "server.h"
+#include "tlb.h"
+#include "trace.h"
+
+uint64_t num_accesses = 0;
 
 // Initialize the system depending on the input parameters.
-void initialize(void) { initialize_cache(); }
+void initialize(void) {
+  initialize_cache();
+  initialize_tlb();
+  initialize_dram();
+}
 
 // Free the allocated memory for a graceful shutdown and to prevent memory
 // leaks.
-void free_memory(void) { free_cache(); }
+void free_memory(void) {
+  event_log_close();
+  interval_close();
+  free_cache();
+  free_tlb();
+  free_dram();
+}
+
+// Drop all cached state and statistics, as if the simulation had just
+// started.
+void reset_system(void) {
+  interval_restart();
+  free_cache();
+  free_tlb();
+  free_dram();
+  reset_cache_statistics();
+  reset_tlb_statistics();
+  reset_dram_statistics();
+  reset_pc_statistics();
+  initialize();
+  num_accesses = 0;
+}
 
 // Print system-wide statistics.
-void print_statistics(void) { print_cache_statistics(); }
+void print_statistics(void) {
+  print_cache_statistics();
+  print_tlb_statistics();
+  print_dram_statistics();
+  print_pc_statistics();
+}
 
 // Print information when verbose is true.
 void handle_verbose(memory_access_entry_t entry, op_result_t ret) {
@@ -29,13 +68,117 @@ void handle_verbose(memory_access_entry_t entry, op_result_t ret) {
 // Check if all input parameters are provided and valid.
 int check_parameters_valid(void) { return check_cache_parameters_valid(); }
 
+static FILE *binary_trace_fp = NULL;
+
+// Advance the access count, taking the -K checkpoint when it is reached.
+static void advance_accesses(uint64_t accesses) {
+  uint64_t before = num_accesses;
+  num_accesses = accesses;
+  interval_tick(num_accesses);
+  if (checkpoint_save_file != NULL && checkpoint_at_access > before &&
+      checkpoint_at_access <= num_accesses) {
+    if (save_cache_checkpoint(checkpoint_save_file, num_accesses)) {
+      printf("Cannot write checkpoint %s.\n", checkpoint_save_file);
+    }
+  }
+}
+
+// Access count after accesses at which a run of repeats has to be cut.
+static uint64_t next_cut(uint64_t accesses) {
+  uint64_t cut = interval_next_end(accesses);
+  if (checkpoint_save_file != NULL && checkpoint_at_access > accesses &&
+      checkpoint_at_access < cut) {
+    cut = checkpoint_at_access;
+  }
+  return cut;
+}
+
+// Credit repeats [first, first + count) of rec as L1 and DTLB hits.
+static void simulate_repeats(const coalesced_access_t *rec, uint64_t pa,
+                             uint64_t first, uint64_t count) {
+  uint64_t writes_before = coalesced_repeat_writes(rec, first);
+  uint32_t writes = (uint32_t)(coalesced_repeat_writes(rec, first + count) - writes_before);
+  uint32_t reads = (uint32_t)(count - writes);
+
+  if (credit_repeated_L1_hits(pa, reads, writes)) {
+    // A prefetch evicted the block: the first repeat misses and refills it,
+    // after which the others hit again.
+    if (coalesced_repeat_writes(rec, first + 1) > writes_before) {
+      writes--;
+      write_to_cache(pa);
+    } else {
+      reads--;
+      read_from_cache(pa);
+    }
+    PREFETCH_ON_ACCESS(pa, rec->pc);
+    credit_repeated_L1_hits(pa, reads, writes);
+  }
+  credit_repeated_tlb_hits((uint32_t)count);
+}
+
+// Simulate one access and, for a coalesced run, credit its repeats as L1
+// hits. Also stores the record and takes the -K checkpoint when due. The
+// repeats are credited in pieces that end at the checkpoint and at interval
+// boundaries, so a record that straddles one leaves the same snapshot and
+// deltas as the accesses it stands for.
+int simulate_record(const coalesced_access_t *rec) {
+  memory_access_entry_t entry;
+  uint64_t pa = 0;
+  op_result_t ret;
+
+  entry.address = rec->address;
+  entry.pc = rec->pc;
+  entry.accesstype = rec->accesstype;
+  event_log_begin_access(num_accesses, entry.address);
+  pa = translate_address(entry);
+  interval_record_access(pa);
+  PC_STATS_BEGIN_ACCESS(entry.pc, coalesced_access_count(rec));
+
+  // Based on the access type, either read from cache or write to cache.
+  if (entry.accesstype == READ) {
+    ret = read_from_cache(pa);
+  } else if (entry.accesstype == WRITE) {
+    ret = write_to_cache(pa);
+  } else {
+    printf("This message should not be printed. Fix your code.\n");
+    return -1;
+  }
+  PREFETCH_ON_ACCESS(pa, entry.pc);
+  advance_accesses(num_accesses + 1);
+
+  uint64_t repeats = coalesced_access_count(rec) - 1;
+  for (uint64_t done = 0; done < repeats;) {
+    uint64_t count = next_cut(num_accesses) - num_accesses;
+    if (count > repeats - done) count = repeats - done;
+    // An interval may have ended since the block was last counted.
+    interval_record_access(pa);
+    simulate_repeats(rec, pa, done, count);
+    done += count;
+    advance_accesses(num_accesses + count);
+  }
+  PC_STATS_END_ACCESS();
+
+  // Handle verbose parameter.
+  if (verbose) {
+    handle_verbose(entry, ret);
+  }
+
+  if (binary_trace_fp != NULL) {
+    write_binary_trace_record(binary_trace_fp, rec);
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
   int opt;
   trace_file = NULL;
   FILE *trace_fp;
   opterr = 0;
   memory_access_entry_t entry;
-  uint32_t pa = 0;
+  coalescer_t coalescer;
+  coalesced_access_t rec;
+  bool binary_trace = false;
+  uint32_t trace_block_size = 0;
   op_result_t ret;
   int r = 0;
 
@@ -44,7 +187,7 @@ int main(int argc, char *argv[]) {
    * lot more to get your code correct. Try to think of different ways that
    * your inputs are not appropriate and accordingly add more code.
    */
-  while ((opt = getopt(argc, argv, "t:vS:B:A:L:P:")) != -1) {
+  while ((opt = getopt(argc, argv, "t:vS:B:A:L:P:H:G:C:R:K:FW:T:E:I:D:M:X:")) != -1) {
     switch (opt) {
     case 'S':
       r = process_arg_S(opt, optarg);
@@ -87,6 +230,89 @@ int main(int argc, char *argv[]) {
         return 0;
       }
       break;
+    case 'H':
+      r = process_arg_H(opt, optarg);
+      if (r) {
+        printf("Improper H parameter\n");
+        return 0;
+      }
+      break;
+    case 'C':
+      r = process_arg_C(opt, optarg);
+      if (r) {
+        printf("Improper C parameter\n");
+        return 0;
+      }
+      break;
+    case 'R':
+      r = process_arg_R(opt, optarg);
+      if (r) {
+        printf("Improper R parameter\n");
+        return 0;
+      }
+      break;
+    case 'K':
+      r = process_arg_K(opt, optarg);
+      if (r) {
+        printf("Improper K parameter\n");
+        return 0;
+      }
+      break;
+    case 'F':
+      coalesce_accesses = 1;
+      break;
+    case 'W':
+      binary_trace_out = optarg;
+      break;
+    case 'T':
+      r = process_arg_T(opt, optarg);
+      if (r) {
+        printf("Improper T parameter\n");
+        return 0;
+      }
+      break;
+    case 'E':
+      r = process_arg_E(opt, optarg);
+      if (r) {
+        printf("Improper E parameter\n");
+        return 0;
+      }
+      break;
+    case 'I':
+      r = process_arg_I(opt, optarg);
+      if (r) {
+        printf("Improper I parameter\n");
+        return 0;
+      }
+      break;
+    case 'D':
+      r = process_arg_D(opt, optarg);
+      if (r) {
+        printf("Improper D parameter\n");
+        return 0;
+      }
+      break;
+    case 'G':
+      r = process_arg_G(opt, optarg);
+      if (r) {
+        printf("Improper G parameter\n");
+        return 0;
+      }
+      break;
+    case 'M':
+      r = process_arg_M(opt, optarg);
+      if (r) {
+        printf("Improper M parameter\n");
+        return 0;
+      }
+      break;
+    case 'X':
+      r = process_arg_X(opt, optarg);
+      if (r) {
+        printf("Improper X parameter\n");
+        return 0;
+      }
+      break;
     case '?':
     default:
       printf("Invalid configuration.\n%s\n", usage_str);
@@ -94,12 +320,15 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // Open the trace file.
-  trace_fp = fopen(trace_file, "r");
+  // Open the trace file. A daemon takes its accesses from clients instead.
+  trace_fp = NULL;
+  if (server_socket_path == NULL) {
+    trace_fp = fopen(trace_file, "r");
 
-  if (trace_fp == NULL) {
-    printf("Trace file does not exists.\n");
-    return -1;
+    if (trace_fp == NULL) {
+      printf("Trace file does not exists.\n");
+      return -1;
+    }
   }
 
   // Check if all required parameters are provided
@@ -114,38 +343,124 @@ int main(int argc, char *argv[]) {
   // Initialize the system (including the cache).
   initialize();
 
-  // Read the trace file, one line at a time.
-  while (1) {
-    entry = process_trace_file_line(trace_fp);
-    pa = translate_address(entry);
-
-    // Based on the access type, either read from cache or write to cache.
-    if (entry.accesstype != INVALID) {
-      if (entry.accesstype == READ) {
-        ret = read_from_cache(pa);
-      } else if (entry.accesstype == WRITE) {
-        ret = write_to_cache(pa);
-      } else {
-        printf("This message should not be printed. Fix your code.\n");
-        return -1;
+  if (event_log_open()) {
+    printf("Cannot write event log %s.\n", event_log_file);
+    free_memory();
+    return -1;
+  }
+
+  // Warm-start from a checkpoint instead of replaying the warm-up.
+  if (checkpoint_restore_file != NULL) {
+    if (load_cache_checkpoint(checkpoint_restore_file)) {
+      printf("Cannot restore checkpoint %s.\n", checkpoint_restore_file);
+      free_memory();
+      return -1;
+    }
+  }
+
+  binary_trace = trace_fp != NULL && is_binary_trace(trace_fp);
+  if (binary_trace) {
+    if (read_binary_trace_header(trace_fp, &trace_block_size) ||
+        trace_block_size > cache_sector_size) {
+      printf("Binary trace does not match the L1 sector size.\n");
+      free_memory();
+      return -1;
+    }
+  }
+
+  if (binary_trace_out != NULL) {
+    binary_trace_fp = fopen(binary_trace_out, "wb");
+    if (binary_trace_fp == NULL ||
+        write_binary_trace_header(binary_trace_fp,
+                                  coalesce_accesses ? cache_sector_size
+                                                    : 1)) {
+      printf("Cannot write binary trace %s.\n", binary_trace_out);
+      free_memory();
+      return -1;
+    }
+  }
+
+  // Runs of accesses to the same sector are collapsed into one record when
+  // the prefilter is enabled; with sectoring a repeat to another sector of
+  // the block could still miss.
+  coalescer_init(&coalescer, cache_sector_size);
+
+  if (interval_open()) {
+    printf("Cannot write interval statistics %s.\n", interval_file);
+    free_memory();
+    return -1;
+  }
+
+  if (pc_stats_open()) {
+    printf("Cannot allocate the PC table.\n");
+    free_memory();
+    return -1;
+  }
+
+  if (server_socket_path != NULL) {
+    // Keep the hierarchy resident and serve clients until one of them asks
+    // for a shutdown.
+    if (run_server()) {
+      printf("Cannot serve on socket %s.\n", server_socket_path);
+    }
+  } else {
+    // Read the trace file, one line (or one binary record) at a time.
+    while (1) {
+      if (binary_trace) {
+        if (!read_binary_trace_record(trace_fp, &rec)) {
+          break;
+        }
+        if (simulate_record(&rec)) {
+          return -1;
+        }
+        continue;
       }
 
-      // Handle verbose parameter.
-      if (verbose) {
-        handle_verbose(entry, ret);
+      entry = process_trace_file_line(trace_fp);
+      if (entry.accesstype == INVALID) {
+        if (coalescer_flush(&coalescer, &rec) && simulate_record(&rec)) {
+          return -1;
+        }
+        break;
+      }
+
+      if (!coalesce_accesses) {
+        rec.address = entry.address;
+        rec.pc = entry.pc;
+        rec.accesstype = entry.accesstype;
+        rec.repeat_write_mask = 0;
+        rec.repeat_reads = 0;
+        rec.repeat_writes = 0;
+        if (simulate_record(&rec)) {
+          return -1;
+        }
+        continue;
+      }
+
+      if (coalescer_push(&coalescer, entry, &rec) && simulate_record(&rec)) {
+        return -1;
       }
-    } else {
-      break;
     }
+
+    fclose(trace_fp);
+  }
+  if (binary_trace_fp != NULL) {
+    fclose(binary_trace_fp);
   }
 
-  fclose(trace_fp);
+  // Without -K the checkpoint is taken at the end of the trace.
+  if (checkpoint_save_file != NULL && checkpoint_at_access == 0) {
+    if (save_cache_checkpoint(checkpoint_save_file, num_accesses)) {
+      printf("Cannot write checkpoint %s.\n", checkpoint_save_file);
+    }
+  }
 
   // Free the allocated memory.
   free_memory();
 
   // Print statistics at the end of the simulation.
   print_statistics();
+  pc_stats_close();
 
   return 0;
 }
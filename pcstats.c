@@ -0,0 +1,124 @@
+#include "pcstats.h"
+#include "cache.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// PCs live in a fixed open-addressing table. Once it is three quarters
+// full, accesses from PCs not seen yet are pooled in one overflow entry so
+// that memory use stays bounded for traces with huge code footprints.
+#define PC_TABLE_BITS 16
+#define PC_TABLE_ENTRIES (1u << PC_TABLE_BITS)
+#define PC_TABLE_LIMIT (PC_TABLE_ENTRIES / 4 * 3)
+
+uint32_t pc_stats_top = 0;
+
+pc_stats_entry_t *pc_stats_current = NULL;
+
+static pc_stats_entry_t *pc_table = NULL;
+static bool *pc_used = NULL;
+static uint32_t pc_count = 0;
+static pc_stats_entry_t pc_overflow;
+
+static uint32_t pc_hash(uint64_t pc) {
+    pc = (pc ^ (pc >> 33)) * 0xFF51AFD7ED558CCDULL;
+    pc ^= pc >> 33;
+    return (uint32_t)(pc >> (64 - PC_TABLE_BITS));
+}
+
+int pc_stats_open(void) {
+    if (pc_stats_top == 0) return 0;
+    pc_table = calloc(PC_TABLE_ENTRIES, sizeof(pc_stats_entry_t));
+    pc_used = calloc(PC_TABLE_ENTRIES, sizeof(bool));
+    if (pc_table == NULL || pc_used == NULL) return -1;
+    reset_pc_statistics();
+    return 0;
+}
+
+void pc_stats_close(void) {
+    free(pc_table);
+    free(pc_used);
+    pc_table = NULL;
+    pc_used = NULL;
+    pc_stats_current = NULL;
+}
+
+void reset_pc_statistics(void) {
+    if (pc_table == NULL) return;
+    memset(pc_table, 0, PC_TABLE_ENTRIES * sizeof(pc_stats_entry_t));
+    memset(pc_used, 0, PC_TABLE_ENTRIES * sizeof(bool));
+    memset(&pc_overflow, 0, sizeof(pc_overflow));
+    pc_count = 0;
+}
+
+static pc_stats_entry_t *lookup_pc(uint64_t pc) {
+    for (uint32_t i = pc_hash(pc);; i = (i + 1) & (PC_TABLE_ENTRIES - 1)) {
+        if (!pc_used[i]) {
+            if (pc_count == PC_TABLE_LIMIT) return &pc_overflow;
+            pc_used[i] = true;
+            pc_table[i].pc = pc;
+            pc_count++;
+            return &pc_table[i];
+        }
+        if (pc_table[i].pc == pc) return &pc_table[i];
+    }
+}
+
+// Bracket the cache access of one (possibly coalesced) trace record so that
+// its misses and writebacks are charged to pc.
+void pc_stats_begin_access(uint64_t pc, uint64_t accesses) {
+    if (pc_table == NULL) return;
+    pc_stats_current = lookup_pc(pc);
+    pc_stats_current->accesses += accesses;
+}
+
+// Worst offenders first: most L1 misses, then most L2 misses.
+static int compare_entries(const void *a, const void *b) {
+    const pc_stats_entry_t *x = *(pc_stats_entry_t *const *)a;
+    const pc_stats_entry_t *y = *(pc_stats_entry_t *const *)b;
+    if (x->L1_misses != y->L1_misses) return x->L1_misses < y->L1_misses ? 1 : -1;
+    if (x->L2_misses != y->L2_misses) return x->L2_misses < y->L2_misses ? 1 : -1;
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+static void print_entry(const char *name, const pc_stats_entry_t *e) {
+    printf("%s: accesses %" PRIu64 ", L1 misses %" PRIu64, name, e->accesses, e->L1_misses);
+    if (cache_level == 2) printf(", L2 misses %" PRIu64, e->L2_misses);
+    printf(", writebacks %" PRIu64 "\n", e->writebacks);
+}
+
+void print_pc_statistics(void) {
+    if (pc_table == NULL) return;
+
+    pc_stats_entry_t **sorted = malloc((pc_count ? pc_count : 1) * sizeof(pc_stats_entry_t *));
+    if (sorted == NULL) return;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < PC_TABLE_ENTRIES; i++) {
+        if (pc_used[i]) sorted[n++] = &pc_table[i];
+    }
+    qsort(sorted, n, sizeof(*sorted), compare_entries);
+
+    printf("\n* PC Statistics *\n");
+    printf("distinct PCs: %" PRIu32 "\n", pc_count);
+    for (uint32_t i = 0; i < n && i < pc_stats_top; i++) {
+        char name[32];
+        if (sorted[i]->pc == 0) {
+            snprintf(name, sizeof(name), "no PC");
+        } else {
+            snprintf(name, sizeof(name), "PC 0x%" PRIx64, sorted[i]->pc);
+        }
+        print_entry(name, sorted[i]);
+    }
+    if (pc_overflow.accesses != 0) print_entry("untracked PCs", &pc_overflow);
+    free(sorted);
+}
+
+// -M takes the number of PCs to report.
+int process_arg_M(int opt, char *optarg) {
+    char *end = NULL;
+    unsigned long n = strtoul(optarg, &end, 10);
+    if (end == optarg || *end != '\0' || n == 0 || n > PC_TABLE_ENTRIES) return 1;
+    pc_stats_top = (uint32_t)n;
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef PCSTATS_H_
+#define PCSTATS_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+// Per-instruction statistics for the demand accesses issued by one PC.
+typedef struct {
+    uint64_t pc;
+    uint64_t accesses;
+    uint64_t L1_misses;
+    uint64_t L2_misses;
+    uint64_t writebacks;
+} pc_stats_entry_t;
+
+// Input parameters.
+extern uint32_t pc_stats_top;
+
+// Entry of the demand access being simulated; NULL outside of one (for
+// instance during page walks) or when per-PC statistics are off.
+extern pc_stats_entry_t *pc_stats_current;
+
+int process_arg_M(int opt, char *optarg);
+int pc_stats_open(void);
+void pc_stats_close(void);
+void reset_pc_statistics(void);
+void pc_stats_begin_access(uint64_t pc, uint64_t accesses);
+void print_pc_statistics(void);
+
+// The bracketing calls are skipped inline when per-PC statistics are off.
+#define PC_STATS_BEGIN_ACCESS(pc, accesses)                                       \
+    do {                                                                          \
+        if (pc_stats_top != 0) pc_stats_begin_access((pc), (accesses));           \
+    } while (0)
+
+#define PC_STATS_END_ACCESS()                                                     \
+    do {                                                                          \
+        pc_stats_current = NULL;                                                  \
+    } while (0)
+
+#define PC_STATS_MISS(level)                                                      \
+    do {                                                                          \
+        if (pc_stats_current != NULL) {                                           \
+            if ((level) == 1) pc_stats_current->L1_misses++;                      \
+            else pc_stats_current->L2_misses++;                                   \
+        }                                                                         \
+    } while (0)
+
+#define PC_STATS_WRITEBACK()                                                      \
+    do {                                                                          \
+        if (pc_stats_current != NULL) pc_stats_current->writebacks++;             \
+    } while (0)
+
+#endif /* PCSTATS_H_ */
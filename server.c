@@ -0,0 +1,178 @@
+#include "server.h"
+#include "cache.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Access records are received straight into one large buffer and simulated
+// from there, so a batch costs one recv() per buffer rather than per record.
+#define SERVER_BUFFER_SIZE (1 << 20)
+#define SERVER_SOCKET_BUFFER (4 << 20)
+#define SERVER_MAX_PATH 4096
+
+char *server_socket_path = NULL;
+
+static int send_reply(int fd, int32_t status, const void *payload, uint32_t length) {
+    server_reply_header_t reply = { status, length };
+    if (write_full(fd, &reply, sizeof(reply))) return -1;
+    return length ? write_full(fd, payload, length) : 0;
+}
+
+// block_size is the granularity declared by the last SERVER_MSG_TRACE, or 0
+// when the client declared none; only uncoalesced records are accepted then.
+static int handle_accesses(int fd, uint8_t *buf, uint32_t length, uint32_t block_size) {
+    const uint32_t batch = SERVER_BUFFER_SIZE - SERVER_BUFFER_SIZE % BINARY_TRACE_RECORD_SIZE;
+    coalesced_access_t rec;
+
+    if (length % BINARY_TRACE_RECORD_SIZE != 0) return -1;
+    while (length > 0) {
+        uint32_t chunk = length < batch ? length : batch;
+        if (read_full(fd, buf, chunk)) return -1;
+        for (uint32_t off = 0; off < chunk; off += BINARY_TRACE_RECORD_SIZE) {
+            decode_binary_trace_record(buf + off, &rec);
+            if (block_size == 0 && (rec.repeat_reads != 0 || rec.repeat_writes != 0)) return -1;
+            if (simulate_record(&rec)) return -1;
+        }
+        length -= chunk;
+    }
+    return 0;
+}
+
+// Coalesced records are only exact for L1 sectors at least as large as the
+// block size they were coalesced at.
+static int handle_trace(int fd, uint32_t length, uint32_t *block_size) {
+    uint32_t size;
+    if (length != sizeof(size) || read_full(fd, &size, sizeof(size))) return -1;
+    if (size == 0 || size > cache_sector_size) return send_reply(fd, -1, NULL, 0);
+    *block_size = size;
+    return send_reply(fd, 0, NULL, 0);
+}
+
+// The statistics printers write to stdout, so point stdout at a temporary
+// file for the duration and send back what they wrote.
+static int handle_stats(int fd) {
+    FILE *tmp = tmpfile();
+    if (tmp == NULL) return send_reply(fd, -1, NULL, 0);
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(fileno(tmp), STDOUT_FILENO);
+    print_statistics();
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    off_t len = lseek(fileno(tmp), 0, SEEK_END);
+    char *text = len > 0 ? malloc(len) : NULL;
+    int ret;
+    if (text == NULL || pread(fileno(tmp), text, len, 0) != len) {
+        ret = send_reply(fd, -1, NULL, 0);
+    } else {
+        ret = send_reply(fd, 0, text, (uint32_t)len);
+    }
+    free(text);
+    fclose(tmp);
+    return ret;
+}
+
+static int handle_snapshot(int fd, uint32_t length) {
+    char path[SERVER_MAX_PATH];
+    if (length == 0 || length >= sizeof(path)) return -1;
+    if (read_full(fd, path, length)) return -1;
+    path[length] = '\0';
+    return send_reply(fd, save_cache_checkpoint(path, num_accesses) ? -1 : 0, NULL, 0);
+}
+
+// Serve one client until it disconnects. Returns 1 when it asked for a
+// shutdown, 0 otherwise.
+static int serve_client(int fd, uint8_t *buf) {
+    server_msg_header_t msg;
+    uint32_t block_size = 0;
+
+    while (read_full(fd, &msg, sizeof(msg)) == 0) {
+        int ret;
+        switch (msg.type) {
+        case SERVER_MSG_ACCESSES:
+            ret = handle_accesses(fd, buf, msg.length, block_size);
+            break;
+        case SERVER_MSG_TRACE:
+            ret = handle_trace(fd, msg.length, &block_size);
+            break;
+        case SERVER_MSG_STATS:
+            ret = handle_stats(fd);
+            break;
+        case SERVER_MSG_RESET:
+            reset_system();
+            ret = send_reply(fd, 0, NULL, 0);
+            break;
+        case SERVER_MSG_SNAPSHOT:
+            ret = handle_snapshot(fd, msg.length);
+            break;
+        case SERVER_MSG_SHUTDOWN:
+            send_reply(fd, 0, NULL, 0);
+            return 1;
+        default:
+            ret = -1;
+            break;
+        }
+        if (ret) break;
+    }
+    return 0;
+}
+
+// Keep the hierarchy resident and serve clients one after another until one
+// of them sends SERVER_MSG_SHUTDOWN.
+int run_server(void) {
+    struct sockaddr_un addr;
+    if (strlen(server_socket_path) >= sizeof(addr.sun_path)) return -1;
+
+    uint8_t *buf = malloc(SERVER_BUFFER_SIZE);
+    if (buf == NULL) return -1;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        free(buf);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, server_socket_path);
+    unlink(server_socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 4) != 0) {
+        close(listen_fd);
+        free(buf);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int shutdown_requested = 0;
+    while (!shutdown_requested) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        int size = SERVER_SOCKET_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        shutdown_requested = serve_client(fd, buf);
+        close(fd);
+    }
+
+    close(listen_fd);
+    unlink(server_socket_path);
+    free(buf);
+    return shutdown_requested ? 0 : -1;
+}
+
+int process_arg_D(int opt, char *optarg) {
+    if (optarg[0] == '\0') return 1;
+    server_socket_path = optarg;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "common.h"
+#include "trace.h"
+
+// Simulation service protocol. Every request is a server_msg_header_t
+// followed by length payload bytes, in host byte order since both ends run on
+// the same machine.
+//
+//   SERVER_MSG_TRACE     payload: uint32_t block size the records of the
+//                        following ACCESSES were coalesced at (1 when they
+//                        were not); rejected when coarser than the L1 sector
+//                        size, just as sim -t rejects such a binary trace
+//   SERVER_MSG_ACCESSES  payload: binary trace records; no reply, so a
+//                        producer can stream batches back to back. Records
+//                        with repeats need a preceding SERVER_MSG_TRACE.
+//   SERVER_MSG_STATS     reply payload: the end-of-run statistics as text
+//   SERVER_MSG_RESET     cold caches and TLBs, all counters zeroed
+//   SERVER_MSG_SNAPSHOT  payload: checkpoint path; same format as -C
+//   SERVER_MSG_SHUTDOWN  stop accepting clients and exit
+//
+// Every request other than ACCESSES is answered with a
+// server_reply_header_t (status 0 on success) and its payload.
+#define SERVER_MSG_ACCESSES 1
+#define SERVER_MSG_STATS 2
+#define SERVER_MSG_RESET 3
+#define SERVER_MSG_SNAPSHOT 4
+#define SERVER_MSG_SHUTDOWN 5
+#define SERVER_MSG_TRACE 6
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;
+} server_msg_header_t;
+
+typedef struct {
+    int32_t status;
+    uint32_t length;
+} server_reply_header_t;
+
+// Shared by the service and simclient.
+static inline int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, MSG_WAITALL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static inline int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Input parameters.
+extern char *server_socket_path;
+
+int process_arg_D(int opt, char *optarg);
+int run_server(void);
+
+// Provided by main.c.
+extern uint64_t num_accesses;
+int simulate_record(const coalesced_access_t *rec);
+void print_statistics(void);
+void reset_system(void);
+
+#endif /* SERVER_H_ */
@@ -0,0 +1,164 @@
+/*
+ * Client for the simulation service started with sim -D.
+ *
+ * Build separately from the simulator:
+ *   cc -O2 -o simclient simclient.c trace.c
+ *
+ * Usage:
+ *   ./simclient -s <socket_path> [-t <trace>] [-p] [-r] [-k <checkpoint>] [-q]
+ *
+ * Options are carried out in the order given, so for example
+ *   ./simclient -s sim.sock -t warmup.trace -r -t phase.trace -p
+ * replays the warm-up, resets the hierarchy, replays the phase and prints
+ * the statistics of the phase alone.
+ *
+ *   -t  stream a text or binary trace to the service
+ *   -p  print the statistics collected so far
+ *   -r  reset caches, TLBs and statistics
+ *   -k  write a checkpoint (same format as sim -C) on the service side
+ *   -q  shut the service down
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+// Records sent per SERVER_MSG_ACCESSES message.
+#define CLIENT_BATCH_RECORDS 65536
+
+static int send_message(int fd, uint32_t type, const void *payload, uint32_t length) {
+    server_msg_header_t msg = { type, length };
+    if (write_full(fd, &msg, sizeof(msg))) return -1;
+    return length ? write_full(fd, payload, length) : 0;
+}
+
+// Send a request and wait for its reply; the reply payload, if any, is
+// written to stdout.
+static int request(int fd, uint32_t type, const void *payload, uint32_t length) {
+    server_reply_header_t reply;
+    if (send_message(fd, type, payload, length) || read_full(fd, &reply, sizeof(reply))) return -1;
+
+    if (reply.length > 0) {
+        char *text = malloc(reply.length);
+        if (text == NULL || read_full(fd, text, reply.length)) {
+            free(text);
+            return -1;
+        }
+        fwrite(text, 1, reply.length, stdout);
+        free(text);
+    }
+    return reply.status;
+}
+
+// Text traces end at the first invalid line, as they do for sim -t.
+static bool next_record(FILE *fp, bool binary, coalesced_access_t *rec) {
+    if (binary) return read_binary_trace_record(fp, rec);
+
+    memory_access_entry_t entry = process_trace_file_line(fp);
+    if (entry.accesstype == INVALID) return false;
+    rec->address = entry.address;
+    rec->pc = entry.pc;
+    rec->accesstype = entry.accesstype;
+    rec->repeat_write_mask = 0;
+    rec->repeat_reads = 0;
+    rec->repeat_writes = 0;
+    return true;
+}
+
+static int send_trace(int fd, const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) return -1;
+
+    uint32_t block_size = 1;
+    bool binary = is_binary_trace(fp);
+    if (binary && read_binary_trace_header(fp, &block_size)) {
+        fclose(fp);
+        return -1;
+    }
+    if (request(fd, SERVER_MSG_TRACE, &block_size, sizeof(block_size))) {
+        fprintf(stderr, "%s is coalesced at %u bytes, coarser than the L1 sectors of the service.\n", path, block_size);
+        fclose(fp);
+        return -1;
+    }
+
+    uint8_t *buf = malloc((size_t)CLIENT_BATCH_RECORDS * BINARY_TRACE_RECORD_SIZE);
+    int ret = buf == NULL ? -1 : 0;
+    coalesced_access_t rec;
+    uint32_t n = 0;
+    while (ret == 0) {
+        bool more = next_record(fp, binary, &rec);
+        if (more) encode_binary_trace_record(buf + (size_t)n++ * BINARY_TRACE_RECORD_SIZE, &rec);
+        if (n == CLIENT_BATCH_RECORDS || (!more && n > 0)) {
+            ret = send_message(fd, SERVER_MSG_ACCESSES, buf, n * BINARY_TRACE_RECORD_SIZE);
+            n = 0;
+        }
+        if (!more) break;
+    }
+
+    free(buf);
+    fclose(fp);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = NULL;
+    int opt;
+
+    // The socket has to be known before any command is carried out.
+    while ((opt = getopt(argc, argv, "s:t:prk:q")) != -1) {
+        if (opt == 's') socket_path = optarg;
+        if (opt == '?') {
+            fprintf(stderr, "Usage: %s -s <socket_path> [-t <trace>] [-p] [-r] [-k <checkpoint>] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (socket_path == NULL) {
+        fprintf(stderr, "No socket given.\n");
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Cannot connect to %s.\n", socket_path);
+        return 1;
+    }
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, "s:t:prk:q")) != -1) {
+        int ret = 0;
+        switch (opt) {
+        case 't':
+            ret = send_trace(fd, optarg);
+            break;
+        case 'p':
+            ret = request(fd, SERVER_MSG_STATS, NULL, 0);
+            break;
+        case 'r':
+            ret = request(fd, SERVER_MSG_RESET, NULL, 0);
+            break;
+        case 'k':
+            ret = request(fd, SERVER_MSG_SNAPSHOT, optarg, (uint32_t)strlen(optarg));
+            break;
+        case 'q':
+            ret = request(fd, SERVER_MSG_SHUTDOWN, NULL, 0);
+            break;
+        }
+        if (ret) {
+            fprintf(stderr, "Request -%c failed.\n", opt);
+            close(fd);
+            return 1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
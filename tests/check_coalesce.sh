@@ -0,0 +1,19 @@
+#!/bin/sh
+# Regression check: the coalescing prefilter (-F) must not change any
+# statistic. coalesce_prefetch.trace has an STR prefetch evict the dirty L2
+# copy of a block between the leading access of a coalesced run and its
+# repeats, which back-invalidates the block from the L1.
+#
+#   tests/check_coalesce.sh ./sim
+set -e
+sim=${1:-./sim}
+dir=$(dirname "$0")
+cfg="-S 1024 -A 4 -B 64 -L 2 -P STR"
+
+plain=$("$sim" -t "$dir/coalesce_prefetch.trace" $cfg)
+coalesced=$("$sim" -t "$dir/coalesce_prefetch.trace" $cfg -F)
+if [ "$plain" != "$coalesced" ]; then
+    echo "FAIL: -F changes the statistics"
+    exit 1
+fi
+echo "ok"
@@ -0,0 +1,531 @@
+#include "tlb.h"
+#include "cache.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define FRAME_SHIFT 12
+#define PT_LEVELS 4
+#define PT_ENTRIES 512
+#define PT_INDEX_BITS 9
+#define PTE_SIZE 8
+#define HUGE_PAGE_SHIFT 21
+#define RANDOM_ALLOC_ATTEMPTS 64
+#define MAX_PHYSICAL_MEMORY_MB (1UL << 20)
+
+#define TLB_CHECKPOINT_NODE 0
+#define TLB_CHECKPOINT_LEAF 1
+
+typedef struct {
+    bool valid;
+    uint64_t vpn;
+    uint64_t pfn;
+    uint64_t lru_counter;
+} tlb_entry_t;
+
+typedef struct {
+    uint32_t num_sets;
+    uint32_t associativity;
+    tlb_entry_t *entries;
+} tlb_t;
+
+// One page of the simulated radix page table. Interior levels point at the
+// next level; the leaf level holds page frame numbers plus one (0 = unmapped).
+typedef struct pt_node {
+    uint64_t phys;
+    struct pt_node *child[PT_ENTRIES];
+    uint64_t pfn[PT_ENTRIES];
+} pt_node_t;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t level;
+    uint64_t va;
+    uint64_t phys;
+} tlb_checkpoint_record_t;
+
+bool tlb_enabled = false;
+uint32_t dtlb_entries = 64;
+uint32_t dtlb_associativity = 4;
+uint32_t stlb_entries = 1536;
+uint32_t stlb_associativity = 12;
+uint32_t page_shift = FRAME_SHIFT;
+page_alloc_policy_t page_alloc_policy = PAGE_ALLOC_FIRST_TOUCH;
+uint64_t page_alloc_seed = 1;
+uint32_t physical_memory_mb = 4096;
+
+uint64_t dtlb_accesses = 0;
+uint64_t dtlb_hits = 0;
+uint64_t dtlb_misses = 0;
+uint64_t stlb_accesses = 0;
+uint64_t stlb_hits = 0;
+uint64_t stlb_misses = 0;
+uint64_t page_walks = 0;
+uint64_t page_walk_pte_accesses = 0;
+uint64_t page_walk_memory_accesses = 0;
+uint64_t pages_allocated = 0;
+
+static tlb_t dtlb;
+static tlb_t stlb;
+static pt_node_t *pt_root = NULL;
+static uint64_t *frame_bitmap = NULL;
+static uint64_t num_frames = 0;
+static uint64_t alloc_cursor = 0;
+static uint64_t rng_state = 0;
+static uint64_t tlb_time = 1;
+static tlb_entry_t *last_dtlb_entry = NULL;
+
+static bool frames_free(uint64_t first, uint64_t count) {
+    for (uint64_t f = first; f < first + count; f++) {
+        if (frame_bitmap[f >> 6] & (1ULL << (f & 63))) return false;
+    }
+    return true;
+}
+
+static void mark_frames(uint64_t first, uint64_t count) {
+    for (uint64_t f = first; f < first + count; f++) {
+        frame_bitmap[f >> 6] |= 1ULL << (f & 63);
+    }
+}
+
+// Allocate count contiguous 4 KiB frames aligned to count. First-touch hands
+// out the lowest free frames in allocation order; random picks aligned slots
+// from a seeded generator so runs are reproducible.
+static uint64_t alloc_frames(uint64_t count) {
+    if (page_alloc_policy == PAGE_ALLOC_RANDOM) {
+        uint64_t slots = num_frames / count;
+        for (int i = 0; i < RANDOM_ALLOC_ATTEMPTS && slots != 0; i++) {
+            uint64_t first = (splitmix64(&rng_state) % slots) * count;
+            if (frames_free(first, count)) {
+                mark_frames(first, count);
+                return first;
+            }
+        }
+    }
+
+    for (uint64_t first = (alloc_cursor + count - 1) & ~(count - 1);
+         first + count <= num_frames; first += count) {
+        if (frames_free(first, count)) {
+            mark_frames(first, count);
+            if (page_alloc_policy == PAGE_ALLOC_FIRST_TOUCH) alloc_cursor = first + count;
+            return first;
+        }
+    }
+
+    // The random policy may have left holes below the cursor.
+    for (uint64_t first = 0; first + count <= num_frames; first += count) {
+        if (frames_free(first, count)) {
+            mark_frames(first, count);
+            return first;
+        }
+    }
+
+    printf("Out of simulated physical memory.\n");
+    exit(-1);
+}
+
+static pt_node_t *new_pt_node(uint64_t phys) {
+    pt_node_t *node = calloc(1, sizeof(pt_node_t));
+    if (node == NULL) {
+        printf("Cannot allocate page table.\n");
+        exit(-1);
+    }
+    node->phys = phys;
+    return node;
+}
+
+static void free_pt_node(pt_node_t *node) {
+    if (node == NULL) return;
+    for (int i = 0; i < PT_ENTRIES; i++) free_pt_node(node->child[i]);
+    free(node);
+}
+
+// Four-level paging translates 48-bit virtual addresses; higher bits are
+// not looked at, as on hardware without 5-level paging.
+static uint32_t pt_index(uint64_t va, int level) {
+    int shift = FRAME_SHIFT + PT_INDEX_BITS * (PT_LEVELS - 1 - level);
+    return (va >> shift) & (PT_ENTRIES - 1);
+}
+
+// Level that holds the leaf PTE for the configured page size.
+static int pt_leaf_level(void) {
+    return PT_LEVELS - 1 - (page_shift - FRAME_SHIFT) / PT_INDEX_BITS;
+}
+
+static void init_tlb_array(tlb_t *tlb, uint32_t entries, uint32_t associativity) {
+    tlb->associativity = associativity;
+    tlb->num_sets = entries / associativity;
+    tlb->entries = calloc(entries, sizeof(tlb_entry_t));
+}
+
+static tlb_entry_t *tlb_lookup(tlb_t *tlb, uint64_t vpn) {
+    tlb_entry_t *set = &tlb->entries[(vpn & (tlb->num_sets - 1)) * tlb->associativity];
+    for (uint32_t way = 0; way < tlb->associativity; way++) {
+        if (set[way].valid && set[way].vpn == vpn) {
+            set[way].lru_counter = tlb_time++;
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+static tlb_entry_t *tlb_fill(tlb_t *tlb, uint64_t vpn, uint64_t pfn) {
+    tlb_entry_t *set = &tlb->entries[(vpn & (tlb->num_sets - 1)) * tlb->associativity];
+    tlb_entry_t *victim = &set[0];
+    for (uint32_t way = 0; way < tlb->associativity; way++) {
+        if (!set[way].valid) {
+            victim = &set[way];
+            break;
+        }
+        if (set[way].lru_counter < victim->lru_counter) victim = &set[way];
+    }
+    victim->valid = true;
+    victim->vpn = vpn;
+    victim->pfn = pfn;
+    victim->lru_counter = tlb_time++;
+    return victim;
+}
+
+// Walk the page table for va, reading every PTE through the data caches and
+// allocating table pages and the data page on first touch.
+static uint64_t page_walk(uint64_t va) {
+    uint64_t memory_before = memory_total_accesses;
+    int leaf = pt_leaf_level();
+    pt_node_t *node = pt_root;
+
+    page_walks++;
+    for (int level = 0; level <= leaf; level++) {
+        uint32_t idx = pt_index(va, level);
+        read_from_cache(node->phys + idx * PTE_SIZE);
+        page_walk_pte_accesses++;
+
+        if (level == leaf) {
+            if (node->pfn[idx] == 0) {
+                uint64_t frames = 1ULL << (page_shift - FRAME_SHIFT);
+                node->pfn[idx] = (alloc_frames(frames) >> (page_shift - FRAME_SHIFT)) + 1;
+                pages_allocated++;
+            }
+            page_walk_memory_accesses += memory_total_accesses - memory_before;
+            return node->pfn[idx] - 1;
+        }
+
+        if (node->child[idx] == NULL) {
+            node->child[idx] = new_pt_node(alloc_frames(1) << FRAME_SHIFT);
+        }
+        node = node->child[idx];
+    }
+    return 0;
+}
+
+void initialize_tlb(void) {
+    if (!tlb_enabled) return;
+
+    init_tlb_array(&dtlb, dtlb_entries, dtlb_associativity);
+    init_tlb_array(&stlb, stlb_entries, stlb_associativity);
+
+    num_frames = ((uint64_t)physical_memory_mb << 20) >> FRAME_SHIFT;
+    frame_bitmap = calloc((num_frames + 63) / 64, sizeof(uint64_t));
+    alloc_cursor = 0;
+    rng_state = page_alloc_seed;
+    tlb_time = 1;
+    last_dtlb_entry = NULL;
+
+    pt_root = new_pt_node(alloc_frames(1) << FRAME_SHIFT);
+}
+
+void free_tlb(void) {
+    if (!tlb_enabled) return;
+    free(dtlb.entries);
+    free(stlb.entries);
+    free(frame_bitmap);
+    free_pt_node(pt_root);
+    dtlb.entries = NULL;
+    stlb.entries = NULL;
+    frame_bitmap = NULL;
+    pt_root = NULL;
+}
+
+void reset_tlb_statistics(void) {
+    dtlb_accesses = dtlb_hits = dtlb_misses = 0;
+    stlb_accesses = stlb_hits = stlb_misses = 0;
+    page_walks = page_walk_pte_accesses = page_walk_memory_accesses = 0;
+    pages_allocated = 0;
+}
+
+uint64_t tlb_translate(uint64_t va) {
+    uint64_t vpn = va >> page_shift;
+    uint64_t offset = va & ((1ULL << page_shift) - 1);
+    tlb_entry_t *e;
+
+    dtlb_accesses++;
+    e = tlb_lookup(&dtlb, vpn);
+    if (e != NULL) {
+        dtlb_hits++;
+        last_dtlb_entry = e;
+        return (e->pfn << page_shift) | offset;
+    }
+    dtlb_misses++;
+
+    stlb_accesses++;
+    e = tlb_lookup(&stlb, vpn);
+    uint64_t pfn;
+    if (e != NULL) {
+        stlb_hits++;
+        pfn = e->pfn;
+    } else {
+        stlb_misses++;
+        pfn = page_walk(va);
+        tlb_fill(&stlb, vpn, pfn);
+    }
+
+    last_dtlb_entry = tlb_fill(&dtlb, vpn, pfn);
+    return (pfn << page_shift) | offset;
+}
+
+// Repeats of a coalesced run stay within one block, hence one page, so they
+// all hit the DTLB entry used by the leading access.
+void credit_repeated_tlb_hits(uint32_t repeats) {
+    if (!tlb_enabled || repeats == 0) return;
+    dtlb_accesses += repeats;
+    dtlb_hits += repeats;
+    if (last_dtlb_entry != NULL) {
+        tlb_time += repeats - 1;
+        last_dtlb_entry->lru_counter = tlb_time++;
+    }
+}
+
+void print_tlb_statistics(void) {
+    if (!tlb_enabled) return;
+    printf("\n* TLB Statistics *\n");
+    printf("DTLB accesses: %" PRIu64 "\n", dtlb_accesses);
+    printf("DTLB hits: %" PRIu64 "\n", dtlb_hits);
+    printf("DTLB misses: %" PRIu64 "\n", dtlb_misses);
+    printf("STLB accesses: %" PRIu64 "\n", stlb_accesses);
+    printf("STLB hits: %" PRIu64 "\n", stlb_hits);
+    printf("STLB misses: %" PRIu64 "\n", stlb_misses);
+    printf("page walks: %" PRIu64 "\n", page_walks);
+    printf("page walk PTE accesses: %" PRIu64 "\n", page_walk_pte_accesses);
+    printf("page walk memory accesses: %" PRIu64 "\n", page_walk_memory_accesses);
+    printf("pages allocated: %" PRIu64 "\n", pages_allocated);
+}
+
+static int parse_tlb_geometry(const char *val, uint32_t *entries, uint32_t *associativity) {
+    char *end = NULL;
+    unsigned long e = strtoul(val, &end, 10);
+    if (end == val || *end != ':') return 1;
+    const char *a_str = end + 1;
+    unsigned long a = strtoul(a_str, &end, 10);
+    if (end == a_str || *end != '\0') return 1;
+    if (e == 0 || a == 0 || e % a != 0 || !is_power_of_two(e / a)) return 1;
+    *entries = (uint32_t)e;
+    *associativity = (uint32_t)a;
+    return 0;
+}
+
+// -T takes a comma-separated list of key=value settings, any of which may be
+// omitted:
+//   dtlb=<entries>:<ways>  stlb=<entries>:<ways>  page=4k|2m
+//   alloc=first|random[:<seed>]  mem=<physical MiB>
+// "-T on" enables translation with the defaults.
+int process_arg_T(int opt, char *optarg) {
+    char buf[256];
+    char *save = NULL;
+    char *end = NULL;
+
+    tlb_enabled = true;
+    if (strcmp(optarg, "on") == 0) return 0;
+    if (strlen(optarg) >= sizeof(buf)) return 1;
+    strcpy(buf, optarg);
+
+    for (char *tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (val == NULL) return 1;
+        *val++ = '\0';
+
+        if (strcmp(tok, "dtlb") == 0) {
+            if (parse_tlb_geometry(val, &dtlb_entries, &dtlb_associativity)) return 1;
+        } else if (strcmp(tok, "stlb") == 0) {
+            if (parse_tlb_geometry(val, &stlb_entries, &stlb_associativity)) return 1;
+        } else if (strcmp(tok, "page") == 0) {
+            if (strcmp(val, "4k") == 0) {
+                page_shift = FRAME_SHIFT;
+            } else if (strcmp(val, "2m") == 0) {
+                page_shift = HUGE_PAGE_SHIFT;
+            } else {
+                return 1;
+            }
+        } else if (strcmp(tok, "alloc") == 0) {
+            if (strcmp(val, "first") == 0) {
+                page_alloc_policy = PAGE_ALLOC_FIRST_TOUCH;
+            } else if (strncmp(val, "random", 6) == 0) {
+                page_alloc_policy = PAGE_ALLOC_RANDOM;
+                if (val[6] == ':') {
+                    page_alloc_seed = strtoull(val + 7, &end, 10);
+                    if (end == val + 7 || *end != '\0') return 1;
+                } else if (val[6] != '\0') {
+                    return 1;
+                }
+            } else {
+                return 1;
+            }
+        } else if (strcmp(tok, "mem") == 0) {
+            unsigned long mb = strtoul(val, &end, 10);
+            if (end == val || *end != '\0') return 1;
+            if (mb < 4 || mb > MAX_PHYSICAL_MEMORY_MB || !is_power_of_two(mb)) return 1;
+            physical_memory_mb = (uint32_t)mb;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int write_tlb_array(FILE *fp, const tlb_t *tlb) {
+    uint32_t n = tlb->num_sets * tlb->associativity;
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t rec[4] = { tlb->entries[i].valid, tlb->entries[i].vpn,
+                            tlb->entries[i].pfn, tlb->entries[i].lru_counter };
+        if (fwrite(rec, sizeof(rec), 1, fp) != 1) return -1;
+    }
+    return 0;
+}
+
+static const uint8_t *read_tlb_array(const uint8_t *p, tlb_t *tlb) {
+    uint32_t n = tlb->num_sets * tlb->associativity;
+    for (uint32_t i = 0; i < n; i++, p += 4 * sizeof(uint64_t)) {
+        uint64_t rec[4];
+        memcpy(rec, p, sizeof(rec));
+        tlb->entries[i].valid = rec[0] != 0;
+        tlb->entries[i].vpn = rec[1];
+        tlb->entries[i].pfn = rec[2];
+        tlb->entries[i].lru_counter = rec[3];
+    }
+    return p;
+}
+
+static uint64_t count_pt_records(const pt_node_t *node, int level) {
+    uint64_t n = 1;
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        if (level == pt_leaf_level()) {
+            if (node->pfn[i] != 0) n++;
+        } else if (node->child[i] != NULL) {
+            n += count_pt_records(node->child[i], level + 1);
+        }
+    }
+    return n;
+}
+
+// Tables are written parents first so the reader can rebuild the tree in a
+// single pass.
+static int write_pt_records(FILE *fp, const pt_node_t *node, int level, uint64_t va) {
+    tlb_checkpoint_record_t rec = { TLB_CHECKPOINT_NODE, (uint32_t)level, va, node->phys };
+    if (fwrite(&rec, sizeof(rec), 1, fp) != 1) return -1;
+
+    int shift = FRAME_SHIFT + PT_INDEX_BITS * (PT_LEVELS - 1 - level);
+    for (uint32_t i = 0; i < PT_ENTRIES; i++) {
+        uint64_t child_va = va | ((uint64_t)i << shift);
+        if (level == pt_leaf_level()) {
+            if (node->pfn[i] == 0) continue;
+            tlb_checkpoint_record_t leaf = { TLB_CHECKPOINT_LEAF, (uint32_t)level, child_va, node->pfn[i] - 1 };
+            if (fwrite(&leaf, sizeof(leaf), 1, fp) != 1) return -1;
+        } else if (node->child[i] != NULL) {
+            if (write_pt_records(fp, node->child[i], level + 1, child_va)) return -1;
+        }
+    }
+    return 0;
+}
+
+// Checkpoint section: configuration, allocator state, both TLB arrays and
+// every page-table page and mapping. The mapping has to travel with the cache
+// contents, otherwise a restored run would place pages at other frames.
+int write_tlb_checkpoint(FILE *fp) {
+    uint32_t cfg[8] = { dtlb_entries, dtlb_associativity, stlb_entries, stlb_associativity,
+                        page_shift, page_alloc_policy, physical_memory_mb, 0 };
+    uint64_t state[4] = { rng_state, tlb_time, alloc_cursor, count_pt_records(pt_root, 0) };
+
+    if (fwrite(cfg, sizeof(cfg), 1, fp) != 1) return -1;
+    if (fwrite(state, sizeof(state), 1, fp) != 1) return -1;
+    if (write_tlb_array(fp, &dtlb) || write_tlb_array(fp, &stlb)) return -1;
+    return write_pt_records(fp, pt_root, 0, 0);
+}
+
+int read_tlb_checkpoint(const uint8_t *p, size_t len) {
+    uint32_t cfg[8];
+    uint64_t state[4];
+    size_t fixed = sizeof(cfg) + sizeof(state)
+        + (size_t)(dtlb_entries + stlb_entries) * 4 * sizeof(uint64_t);
+
+    if (len < fixed) return -1;
+    memcpy(cfg, p, sizeof(cfg));
+    memcpy(state, p + sizeof(cfg), sizeof(state));
+    if (state[3] > (len - fixed) / sizeof(tlb_checkpoint_record_t)) return -1;
+    if (cfg[0] != dtlb_entries || cfg[1] != dtlb_associativity
+        || cfg[2] != stlb_entries || cfg[3] != stlb_associativity
+        || cfg[4] != page_shift || cfg[5] != (uint32_t)page_alloc_policy
+        || cfg[6] != physical_memory_mb
+        || len != fixed + state[3] * sizeof(tlb_checkpoint_record_t)) {
+        return -1;
+    }
+
+    // Start over from an empty page table; the root is in the records.
+    free_pt_node(pt_root);
+    pt_root = NULL;
+    memset(frame_bitmap, 0, ((num_frames + 63) / 64) * sizeof(uint64_t));
+
+    p = read_tlb_array(p + sizeof(cfg) + sizeof(state), &dtlb);
+    p = read_tlb_array(p, &stlb);
+
+    // Records come from the file, so every table and page has to land inside
+    // the simulated memory and in a slot that is still empty.
+    int leaf = pt_leaf_level();
+    uint64_t page_frames = 1ULL << (page_shift - FRAME_SHIFT);
+    for (uint64_t i = 0; i < state[3]; i++, p += sizeof(tlb_checkpoint_record_t)) {
+        tlb_checkpoint_record_t rec;
+        memcpy(&rec, p, sizeof(rec));
+
+        if (rec.kind == TLB_CHECKPOINT_NODE) {
+            if (rec.level > (uint32_t)leaf || (rec.phys >> FRAME_SHIFT) >= num_frames) return -1;
+        } else if (rec.kind == TLB_CHECKPOINT_LEAF) {
+            if (rec.level != (uint32_t)leaf || rec.phys >= num_frames
+                || rec.phys * page_frames + page_frames > num_frames) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+
+        if (rec.kind == TLB_CHECKPOINT_NODE && rec.level == 0) {
+            if (pt_root != NULL) return -1;
+            pt_root = new_pt_node(rec.phys);
+            mark_frames(rec.phys >> FRAME_SHIFT, 1);
+            continue;
+        }
+        if (pt_root == NULL) return -1;
+
+        // Descend to the parent of the table (or to the leaf table).
+        int depth = rec.kind == TLB_CHECKPOINT_NODE ? (int)rec.level - 1 : (int)rec.level;
+        pt_node_t *node = pt_root;
+        for (int level = 0; level < depth; level++) {
+            node = node->child[pt_index(rec.va, level)];
+            if (node == NULL) return -1;
+        }
+
+        uint32_t idx = pt_index(rec.va, depth);
+        if (rec.kind == TLB_CHECKPOINT_NODE) {
+            if (node->child[idx] != NULL) return -1;
+            node->child[idx] = new_pt_node(rec.phys);
+            mark_frames(rec.phys >> FRAME_SHIFT, 1);
+        } else {
+            if (node->pfn[idx] != 0) return -1;
+            node->pfn[idx] = rec.phys + 1;
+            mark_frames(rec.phys * page_frames, page_frames);
+        }
+    }
+
+    alloc_cursor = state[2];
+    rng_state = state[0];
+    tlb_time = state[1];
+    last_dtlb_entry = NULL;
+    return pt_root == NULL ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TLB_H_
+#define TLB_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+typedef enum {
+    PAGE_ALLOC_FIRST_TOUCH,
+    PAGE_ALLOC_RANDOM
+} page_alloc_policy_t;
+
+// Input parameters to control address translation. The TLB model is off
+// unless -T is given, in which case it replaces the fixed address mask.
+extern bool tlb_enabled;
+extern uint32_t dtlb_entries;
+extern uint32_t dtlb_associativity;
+extern uint32_t stlb_entries;
+extern uint32_t stlb_associativity;
+extern uint32_t page_shift;
+extern page_alloc_policy_t page_alloc_policy;
+extern uint64_t page_alloc_seed;
+extern uint32_t physical_memory_mb;
+
+// TLB statistics counters.
+extern uint64_t dtlb_accesses;
+extern uint64_t dtlb_hits;
+extern uint64_t dtlb_misses;
+extern uint64_t stlb_accesses;
+extern uint64_t stlb_hits;
+extern uint64_t stlb_misses;
+extern uint64_t page_walks;
+extern uint64_t page_walk_pte_accesses;
+extern uint64_t page_walk_memory_accesses;
+extern uint64_t pages_allocated;
+
+void initialize_tlb(void);
+void free_tlb(void);
+void reset_tlb_statistics(void);
+void print_tlb_statistics(void);
+int process_arg_T(int opt, char *optarg);
+
+uint64_t tlb_translate(uint64_t va);
+void credit_repeated_tlb_hits(uint32_t repeats);
+
+int write_tlb_checkpoint(FILE *fp);
+int read_tlb_checkpoint(const uint8_t *p, size_t len);
+
+#endif /* TLB_H_ */
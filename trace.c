@@ -0,0 +1,195 @@
+#include "trace.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BINARY_TRACE_MAGIC "CSIMTRCE"
+#define BINARY_TRACE_VERSION 5
+#define BINARY_TRACE_HEADER_SIZE 16
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+// Read one entry at a time from a text trace. Each line is an operation and
+// an address, optionally followed by the PC of the issuing instruction. sim
+// and simclient share this parser so that they accept the same traces.
+memory_access_entry_t process_trace_file_line(FILE *trace_fp) {
+    memory_access_entry_t entry;
+    char line[256];
+    char operation;
+    uint64_t address = 0;
+    uint64_t pc = 0;
+    bool found = false;
+
+    // Parsed by hand: sscanf dominates the cost of text traces. Blank lines
+    // are skipped.
+    while (!found && fgets(line, sizeof(line), trace_fp) != NULL) {
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') continue;
+        operation = *p++;
+        char *end;
+        address = strtoull(p, &end, 16);
+        pc = strtoull(end, &end, 16);
+        found = true;
+    }
+    if (found) {
+        if (operation == 'R') {
+            entry.address = address;
+            entry.pc = pc;
+            entry.accesstype = READ;
+        } else if (operation == 'W') {
+            entry.address = address;
+            entry.pc = pc;
+            entry.accesstype = WRITE;
+        } else {
+            entry.address = 0;
+            entry.pc = 0;
+            entry.accesstype = INVALID;
+        }
+    } else {
+        entry.address = 0;
+        entry.pc = 0;
+        entry.accesstype = INVALID;
+    }
+
+    return entry;
+}
+
+void coalescer_init(coalescer_t *c, uint32_t block_size) {
+    c->block_mask = ~((uint64_t)block_size - 1);
+    c->pending = false;
+    memset(&c->cur, 0, sizeof(c->cur));
+}
+
+// Feed one access. Returns true and fills out when the access ends the
+// previous run; the new access then starts the next run. A change of PC also
+// ends a run so that per-PC statistics stay exact.
+bool coalescer_push(coalescer_t *c, memory_access_entry_t entry, coalesced_access_t *out) {
+    if (c->pending && ((entry.address ^ c->cur.address) & c->block_mask) == 0 && entry.pc == c->cur.pc) {
+        uint64_t n = (uint64_t)c->cur.repeat_reads + c->cur.repeat_writes;
+        uint32_t write = entry.accesstype == WRITE;
+        uint32_t last = (c->cur.repeat_write_mask >> (REPEAT_WRITE_MASK_BITS - 1)) & 1;
+
+        // Past the mask a run only continues with the type of its last bit.
+        if (n < REPEAT_WRITE_MASK_BITS || write == last) {
+            if (write && c->cur.repeat_writes != UINT32_MAX) {
+                if (n < REPEAT_WRITE_MASK_BITS) c->cur.repeat_write_mask |= 1u << n;
+                c->cur.repeat_writes++;
+                return false;
+            }
+            if (!write && c->cur.repeat_reads != UINT32_MAX) {
+                c->cur.repeat_reads++;
+                return false;
+            }
+        }
+    }
+
+    bool emitted = c->pending;
+    if (emitted) *out = c->cur;
+
+    c->pending = true;
+    c->cur.address = entry.address;
+    c->cur.pc = entry.pc;
+    c->cur.accesstype = entry.accesstype;
+    c->cur.repeat_write_mask = 0;
+    c->cur.repeat_reads = 0;
+    c->cur.repeat_writes = 0;
+    return emitted;
+}
+
+// Emit the run in progress, if any.
+bool coalescer_flush(coalescer_t *c, coalesced_access_t *out) {
+    if (!c->pending) return false;
+    *out = c->cur;
+    c->pending = false;
+    return true;
+}
+
+// Writes among the first n repeats of rec. The result is kept consistent
+// with the repeat counts even when a record from a file or socket has a mask
+// that disagrees with them.
+uint64_t coalesced_repeat_writes(const coalesced_access_t *rec, uint64_t n) {
+    uint64_t bits = n < REPEAT_WRITE_MASK_BITS ? n : REPEAT_WRITE_MASK_BITS;
+    uint64_t writes = __builtin_popcount(rec->repeat_write_mask & ((1u << bits) - 1));
+    if (n > REPEAT_WRITE_MASK_BITS && ((rec->repeat_write_mask >> (REPEAT_WRITE_MASK_BITS - 1)) & 1)) {
+        writes += n - REPEAT_WRITE_MASK_BITS;
+    }
+    if (writes > rec->repeat_writes) writes = rec->repeat_writes;
+    if (n > rec->repeat_reads && writes < n - rec->repeat_reads) writes = n - rec->repeat_reads;
+    return writes;
+}
+
+bool is_binary_trace(FILE *fp) {
+    char magic[8];
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    rewind(fp);
+    return n == sizeof(magic) && memcmp(magic, BINARY_TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+int write_binary_trace_header(FILE *fp, uint32_t block_size) {
+    uint8_t buf[BINARY_TRACE_HEADER_SIZE];
+    memcpy(buf, BINARY_TRACE_MAGIC, 8);
+    put_u32(buf + 8, BINARY_TRACE_VERSION);
+    put_u32(buf + 12, block_size);
+    return fwrite(buf, sizeof(buf), 1, fp) == 1 ? 0 : -1;
+}
+
+void encode_binary_trace_record(uint8_t *buf, const coalesced_access_t *rec) {
+    put_u64(buf, rec->address);
+    put_u32(buf + 8, rec->accesstype | (rec->repeat_write_mask << 8));
+    put_u32(buf + 12, rec->repeat_reads);
+    put_u32(buf + 16, rec->repeat_writes);
+    put_u64(buf + 20, rec->pc);
+}
+
+void decode_binary_trace_record(const uint8_t *buf, coalesced_access_t *rec) {
+    rec->address = get_u64(buf);
+    uint32_t type = get_u32(buf + 8);
+    rec->accesstype = (type & 0xFF) == WRITE ? WRITE : READ;
+    rec->repeat_write_mask = (type >> 8) & ((1u << REPEAT_WRITE_MASK_BITS) - 1);
+    rec->repeat_reads = get_u32(buf + 12);
+    rec->repeat_writes = get_u32(buf + 16);
+    rec->pc = get_u64(buf + 20);
+}
+
+int write_binary_trace_record(FILE *fp, const coalesced_access_t *rec) {
+    uint8_t buf[BINARY_TRACE_RECORD_SIZE];
+    encode_binary_trace_record(buf, rec);
+    return fwrite(buf, sizeof(buf), 1, fp) == 1 ? 0 : -1;
+}
+
+// block_size is the granularity the records were coalesced at; a stream is
+// only exact for L1 blocks at least that large.
+int read_binary_trace_header(FILE *fp, uint32_t *block_size) {
+    uint8_t buf[BINARY_TRACE_HEADER_SIZE];
+    if (fread(buf, sizeof(buf), 1, fp) != 1) return -1;
+    if (memcmp(buf, BINARY_TRACE_MAGIC, 8) != 0) return -1;
+    if (get_u32(buf + 8) != BINARY_TRACE_VERSION) return -1;
+    *block_size = get_u32(buf + 12);
+    return 0;
+}
+
+bool read_binary_trace_record(FILE *fp, coalesced_access_t *rec) {
+    uint8_t buf[BINARY_TRACE_RECORD_SIZE];
+    if (fread(buf, sizeof(buf), 1, fp) != 1) return false;
+    decode_binary_trace_record(buf, rec);
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "common.h"
+#include <stdbool.h>
+
+// Input parameters.
+extern uint32_t coalesce_accesses;
+extern char *binary_trace_out;
+
+// One access plus the follow-up accesses to the same block. The repeats hit
+// in the L1 unless the leading access triggered a prefetch that evicted the
+// block. All of them were issued by the same pc.
+//
+// Bit i of repeat_write_mask is set when repeat i is a write; repeats past
+// the last bit have the type of the last bit. The order lets a record be
+// split at any access, e.g. at the -K checkpoint, and the evicted-block case
+// be replayed exactly.
+#define REPEAT_WRITE_MASK_BITS 23
+
+typedef struct {
+    uint64_t address;
+    uint64_t pc;
+    uint8_t accesstype;
+    uint32_t repeat_write_mask;
+    uint32_t repeat_reads;
+    uint32_t repeat_writes;
+} coalesced_access_t;
+
+// Collapses runs of consecutive accesses to the same block.
+typedef struct {
+    uint64_t block_mask;
+    bool pending;
+    coalesced_access_t cur;
+} coalescer_t;
+
+memory_access_entry_t process_trace_file_line(FILE *trace_fp);
+
+void coalescer_init(coalescer_t *c, uint32_t block_size);
+bool coalescer_push(coalescer_t *c, memory_access_entry_t entry, coalesced_access_t *out);
+bool coalescer_flush(coalescer_t *c, coalesced_access_t *out);
+
+static inline uint64_t coalesced_access_count(const coalesced_access_t *rec) {
+    return 1 + (uint64_t)rec->repeat_reads + rec->repeat_writes;
+}
+
+uint64_t coalesced_repeat_writes(const coalesced_access_t *rec, uint64_t n);
+
+// Binary trace files hold a small header followed by fixed-size
+// coalesced_access_t records. Plain traces are just records with no repeats.
+// The same record encoding is used on the simulation service socket.
+#define BINARY_TRACE_RECORD_SIZE 28
+
+void encode_binary_trace_record(uint8_t *buf, const coalesced_access_t *rec);
+void decode_binary_trace_record(const uint8_t *buf, coalesced_access_t *rec);
+bool is_binary_trace(FILE *fp);
+int write_binary_trace_header(FILE *fp, uint32_t block_size);
+int write_binary_trace_record(FILE *fp, const coalesced_access_t *rec);
+int read_binary_trace_header(FILE *fp, uint32_t *block_size);
+bool read_binary_trace_record(FILE *fp, coalesced_access_t *rec);
+
+#endif /* TRACE_H_ */